@@ -0,0 +1,25 @@
+#!/bin/sh
+# build and run ycbcrTest on PC (gcc, binutils)
+# ycbcr.c is built twice: C path, and SIMD path with the intrinsics emulated by host/stm32f4xx.h
+# host/ has the stubs of the board headers (intrinsics, FatFs, CMSIS-RTOS) so that ycbcr.c and libjpeg in this repository are built as they are
+set -e
+cd "$(dirname "$0")"
+ROOT=../..
+JPEG=$ROOT/Middlewares/Third_Party/LibJPEG
+OUT=out
+CFLAGS="-O2 -std=gnu99 -Wall -Ihost -I$ROOT/Inc -I$ROOT/Src/service -I$JPEG/include"
+mkdir -p $OUT
+
+gcc $CFLAGS -c $ROOT/Src/service/ycbcr.c -o $OUT/ycbcr.o
+gcc $CFLAGS -D__ARM_FEATURE_DSP=1 -c $ROOT/Src/service/ycbcr.c -o $OUT/ycbcr_simd_tmp.o
+objcopy --redefine-sym ycbcr_convertRGB565To420=simd_convertRGB565To420 --keep-global-symbol=simd_convertRGB565To420 $OUT/ycbcr_simd_tmp.o $OUT/ycbcr_simd.o
+
+JPEG_SRCS="jcapimin jcparam jccolor jcomapi jerror jmemmgr jmemnobs jutils jcmarker"
+JPEG_OBJS=""
+for src in $JPEG_SRCS; do
+  gcc $CFLAGS -w -c $JPEG/source/$src.c -o $OUT/$src.o
+  JPEG_OBJS="$JPEG_OBJS $OUT/$src.o"
+done
+
+gcc $CFLAGS ycbcrTest.c $OUT/ycbcr.o $OUT/ycbcr_simd.o $JPEG_OBJS -o $OUT/ycbcrTest
+./$OUT/ycbcrTest
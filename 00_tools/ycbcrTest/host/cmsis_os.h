@@ -0,0 +1,10 @@
+/*
+ * cmsis_os.h (for PC)
+ *
+ * stub of CMSIS-RTOS for ycbcrTest. nothing is used by libjpeg in the test
+ */
+
+#ifndef YCBCR_TEST_CMSIS_OS_H_
+#define YCBCR_TEST_CMSIS_OS_H_
+
+#endif /* YCBCR_TEST_CMSIS_OS_H_ */
@@ -0,0 +1,14 @@
+/*
+ * ff.h (for PC)
+ *
+ * stub of FatFs for ycbcrTest. libjpeg (Inc/jdata_conf.h) only needs the FIL type, and no file is accessed in the test
+ */
+
+#ifndef YCBCR_TEST_FF_H_
+#define YCBCR_TEST_FF_H_
+
+#include <stdio.h>
+
+typedef FILE FIL;
+
+#endif /* YCBCR_TEST_FF_H_ */
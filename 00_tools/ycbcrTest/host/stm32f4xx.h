@@ -0,0 +1,27 @@
+/*
+ * stm32f4xx.h (for PC)
+ *
+ * replaces the CMSIS header when ycbcr.c is built with __ARM_FEATURE_DSP on PC (ycbcrTest)
+ * only the SIMD intrinsics used by ycbcr.c are emulated, following the pseudo code of ARMv7-M Architecture Reference Manual
+ */
+
+#ifndef YCBCR_TEST_STM32F4XX_H_
+#define YCBCR_TEST_STM32F4XX_H_
+
+#include <stdint.h>
+
+/* SMLAD: signed 16 x 16 multiply of both halves, and add both products to the 32-bit accumulator (wraps around) */
+static inline uint32_t __SMLAD(uint32_t op1, uint32_t op2, uint32_t op3)
+{
+  int32_t lo = (int32_t)(int16_t)(op1 & 0xFFFF) * (int16_t)(op2 & 0xFFFF);
+  int32_t hi = (int32_t)(int16_t)(op1 >> 16) * (int16_t)(op2 >> 16);
+  return op3 + (uint32_t)lo + (uint32_t)hi;
+}
+
+/* PKHBT: bottom half of op1, top half of (op2 LSL sh) */
+#define __PKHBT(op1, op2, sh)  ( ((uint32_t)(op1) & 0x0000FFFF) | (((uint32_t)(op2) << (sh)) & 0xFFFF0000) )
+
+/* PKHTB: top half of op1, bottom half of (op2 ASR sh) */
+#define __PKHTB(op1, op2, sh)  ( ((uint32_t)(op1) & 0xFFFF0000) | ((uint32_t)((int32_t)(op2) >> (sh)) & 0x0000FFFF) )
+
+#endif /* YCBCR_TEST_STM32F4XX_H_ */
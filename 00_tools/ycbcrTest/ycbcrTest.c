@@ -0,0 +1,182 @@
+/*
+ * ycbcrTest.c
+ *
+ *  Created on: 2017/09/16
+ *      Author: take-iwiw
+ *
+ * host test for ycbcr_convertRGB565To420 (Src/service/ycbcr.c). build and run with build.sh
+ *  - exactness: SIMD path (built with emulated intrinsics in host/stm32f4xx.h) == C path
+ *  - exactness: Y == jccolor.c, Cb/Cr == jccolor.c + h2v2 downsample of jcsample.c within +-1
+ *  - micro benchmark on PC (ns/pixel). this is only a relative number. measure on the board with perf for the real one
+ */
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#define JPEG_INTERNALS
+#include "jpeglib.h"
+#include "ycbcr.h"
+
+/*** Internal Const Values, Macros ***/
+#define WIDTH   320
+#define HEIGHT  240
+#define BENCH_LOOP_NUM  300
+#define CHROMA_DIFF_MAX 1
+
+/*** Internal Static Variables ***/
+static uint16_t s_rgb565[HEIGHT * WIDTH];
+static uint8_t s_y[HEIGHT][WIDTH], s_cb[HEIGHT/2][WIDTH/2], s_cr[HEIGHT/2][WIDTH/2];
+static uint8_t s_ySimd[HEIGHT][WIDTH], s_cbSimd[HEIGHT/2][WIDTH/2], s_crSimd[HEIGHT/2][WIDTH/2];
+static uint8_t s_rgb888[HEIGHT][WIDTH * 3];
+static uint8_t s_yJpeg[HEIGHT][WIDTH], s_cbJpeg[HEIGHT][WIDTH], s_crJpeg[HEIGHT][WIDTH];
+static uint8_t s_cbJpeg420[HEIGHT/2][WIDTH/2], s_crJpeg420[HEIGHT/2][WIDTH/2];
+
+/*** Internal Function Declarations ***/
+/* ycbcr_convertRGB565To420 of the SIMD build (renamed by objcopy in build.sh) */
+void simd_convertRGB565To420(const uint16_t *p_rgb565, uint32_t width, uint8_t *p_y0, uint8_t *p_y1, uint8_t *p_cb, uint8_t *p_cr);
+static void makeImage();
+static void convert(void (*func)(const uint16_t*, uint32_t, uint8_t*, uint8_t*, uint8_t*, uint8_t*), uint8_t y[][WIDTH], uint8_t cb[][WIDTH/2], uint8_t cr[][WIDTH/2]);
+static void downsampleH2V2(uint8_t in[][WIDTH], uint8_t out[][WIDTH/2]);
+static double getTimeSec();
+
+/*** External Function Defines ***/
+/* memory of libjpeg (Src/service/jpegMem.c on the board) */
+void *jpegMem_alloc(size_t size)
+{
+  return malloc(size);
+}
+
+void jpegMem_free(void *p)
+{
+  free(p);
+}
+
+int main()
+{
+  int isFailed = 0;
+  makeImage();
+
+  /*** SIMD path vs C path ***/
+  convert(ycbcr_convertRGB565To420, s_y, s_cb, s_cr);
+  convert(simd_convertRGB565To420, s_ySimd, s_cbSimd, s_crSimd);
+  int isSame = !memcmp(s_y, s_ySimd, sizeof(s_y)) && !memcmp(s_cb, s_cbSimd, sizeof(s_cb)) && !memcmp(s_cr, s_crSimd, sizeof(s_cr));
+  printf("SIMD (emulated) vs C: %s\n", isSame ? "same" : "DIFFERENT");
+  if(!isSame) isFailed = 1;
+
+  /*** C path vs libjpeg (jccolor.c + h2v2 downsample of jcsample.c) ***/
+  struct jpeg_compress_struct cinfo;
+  struct jpeg_error_mgr jerr;
+  cinfo.err = jpeg_std_error(&jerr);
+  jpeg_create_compress(&cinfo);
+  cinfo.image_width = WIDTH;
+  cinfo.image_height = HEIGHT;
+  cinfo.input_components = 3;
+  cinfo.in_color_space = JCS_RGB;
+  jpeg_set_defaults(&cinfo);
+  jinit_color_converter(&cinfo);
+  (*cinfo.cconvert->start_pass)(&cinfo);
+
+  JSAMPROW inRows[HEIGHT], yRows[HEIGHT], cbRows[HEIGHT], crRows[HEIGHT];
+  JSAMPARRAY outRows[3] = {yRows, cbRows, crRows};
+  for(int y = 0; y < HEIGHT; y++) {
+    inRows[y] = s_rgb888[y];
+    yRows[y]  = s_yJpeg[y];
+    cbRows[y] = s_cbJpeg[y];
+    crRows[y] = s_crJpeg[y];
+  }
+  (*cinfo.cconvert->color_convert)(&cinfo, inRows, outRows, 0, HEIGHT);
+  downsampleH2V2(s_cbJpeg, s_cbJpeg420);
+  downsampleH2V2(s_crJpeg, s_crJpeg420);
+
+  int yDiffNum = 0;
+  for(int y = 0; y < HEIGHT; y++) {
+    for(int x = 0; x < WIDTH; x++) {
+      if(s_y[y][x] != s_yJpeg[y][x]) yDiffNum++;
+    }
+  }
+  int chromaDiffMax = 0;
+  long chromaDiffHist[3] = {0};   // |diff| = 0, 1, >=2
+  for(int y = 0; y < HEIGHT/2; y++) {
+    for(int x = 0; x < WIDTH/2; x++) {
+      int diffCb = abs(s_cb[y][x] - s_cbJpeg420[y][x]);
+      int diffCr = abs(s_cr[y][x] - s_crJpeg420[y][x]);
+      int diff = diffCb > diffCr ? diffCb : diffCr;
+      if(diff > chromaDiffMax) chromaDiffMax = diff;
+      chromaDiffHist[diff > 2 ? 2 : diff]++;
+    }
+  }
+  printf("C vs jccolor.c: Y mismatch %d / %d\n", yDiffNum, WIDTH * HEIGHT);
+  printf("C vs jccolor.c + h2v2 downsample: Cb/Cr |diff| 0:%ld, 1:%ld, >=2:%ld (max %d)\n", chromaDiffHist[0], chromaDiffHist[1], chromaDiffHist[2], chromaDiffMax);
+  if(yDiffNum != 0 || chromaDiffMax > CHROMA_DIFF_MAX) isFailed = 1;
+
+  /*** micro benchmark ***/
+  double t0 = getTimeSec();
+  for(int n = 0; n < BENCH_LOOP_NUM; n++) convert(ycbcr_convertRGB565To420, s_y, s_cb, s_cr);
+  double t1 = getTimeSec();
+  for(int n = 0; n < BENCH_LOOP_NUM; n++) convert(simd_convertRGB565To420, s_ySimd, s_cbSimd, s_crSimd);
+  double t2 = getTimeSec();
+  for(int n = 0; n < BENCH_LOOP_NUM; n++) {
+    (*cinfo.cconvert->color_convert)(&cinfo, inRows, outRows, 0, HEIGHT);
+    downsampleH2V2(s_cbJpeg, s_cbJpeg420);
+    downsampleH2V2(s_crJpeg, s_crJpeg420);
+  }
+  double t3 = getTimeSec();
+  double pixelNum = (double)BENCH_LOOP_NUM * WIDTH * HEIGHT;
+  printf("PC: C %.2f ns/pixel, SIMD (emulated) %.2f ns/pixel, jccolor.c + h2v2 downsample (from RGB888) %.2f ns/pixel\n",
+      (t1 - t0) / pixelNum * 1e9, (t2 - t1) / pixelNum * 1e9, (t3 - t2) / pixelNum * 1e9);
+
+  jpeg_destroy_compress(&cinfo);
+
+  printf("%s\n", isFailed ? "NG" : "OK");
+  return isFailed;
+}
+
+/*** Internal Function Defines ***/
+/* random pixels, smooth gradient and black/white extremes. RGB888 is expanded from RGB565 as the camera image is */
+static void makeImage()
+{
+  srand(1);
+  for(int i = 0; i < WIDTH * HEIGHT; i++) {
+    int x = i % WIDTH;
+    int y = i / WIDTH;
+    if(i < WIDTH * HEIGHT / 3) {
+      s_rgb565[i] = (uint16_t)rand();
+    } else if(i < WIDTH * HEIGHT * 2 / 3) {
+      s_rgb565[i] = (uint16_t)(((x >> 3) << 11) | ((y >> 2) << 5) | ((x + y) >> 4));
+    } else {
+      s_rgb565[i] = (i & 1) ? 0xFFFF : 0x0000;
+    }
+    uint32_t r = s_rgb565[i] >> 11;
+    uint32_t g = (s_rgb565[i] >> 5) & 0x3F;
+    uint32_t b = s_rgb565[i] & 0x1F;
+    s_rgb888[y][x * 3 + 0] = (uint8_t)((r << 3) | (r >> 2));
+    s_rgb888[y][x * 3 + 1] = (uint8_t)((g << 2) | (g >> 4));
+    s_rgb888[y][x * 3 + 2] = (uint8_t)((b << 3) | (b >> 2));
+  }
+}
+
+static void convert(void (*func)(const uint16_t*, uint32_t, uint8_t*, uint8_t*, uint8_t*, uint8_t*), uint8_t y[][WIDTH], uint8_t cb[][WIDTH/2], uint8_t cr[][WIDTH/2])
+{
+  for(int line = 0; line < HEIGHT; line += 2) {
+    func(s_rgb565 + line * WIDTH, WIDTH, y[line], y[line + 1], cb[line / 2], cr[line / 2]);
+  }
+}
+
+/* same as h2v2_downsample in jcsample.c: (sum of 2x2 + bias) >> 2, bias alternates 1, 2 */
+static void downsampleH2V2(uint8_t in[][WIDTH], uint8_t out[][WIDTH/2])
+{
+  for(int y = 0; y < HEIGHT/2; y++) {
+    for(int x = 0; x < WIDTH/2; x++) {
+      int bias = (x & 1) ? 2 : 1;
+      out[y][x] = (uint8_t)((in[2*y][2*x] + in[2*y][2*x + 1] + in[2*y + 1][2*x] + in[2*y + 1][2*x + 1] + bias) >> 2);
+    }
+  }
+}
+
+static double getTimeSec()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
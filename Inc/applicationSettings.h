@@ -14,12 +14,140 @@
 #define MOTION_JPEG_FPS_MSEC     200   // target is 5fps
 #define MOTION_JPEG_FPS_MSEC_EX  100   // play motion jpeg(not recorded by this device) as 10fps
 
-#define JPEG_QUALITY 60   // 1 - 100
+/* camera output for movie recording (preview during recording becomes grayscale in YUV422 mode) */
+/* 0: RGB565 (same as still image) */
+/* 1: YUV422, encoded as YCbCr 4:2:2 without color conversion */
+/* 2: YUV422, encoded as YCbCr 4:2:0 (Cb, Cr of 2 lines are averaged. fastest) */
+#define MOTION_JPEG_YUV422           1
+#define MOTION_JPEG_FPS_MSEC_YUV422  100   // target is 10fps
+
+#define JPEG_QUALITY 60   // 10 - 100 (step 10. tables for each step are precomputed in jpegTable.c)
+
+/* restart interval written to JPEG (DRI) in MCU rows (0 = no restart marker) */
+/* broken data (e.g. SPI error) damages the image only up to the next restart marker */
+/* playback uses the markers to decode only a band of the image (e.g. to erase OSD) */
+#define JPEG_RESTART_ROWS  1
+
+/* constant bitrate control for movie recording */
+/* quality of each frame is adjusted between MIN and MAX (starting from the current quality) to keep the target bytes/sec and fps */
+#define MOTION_JPEG_RATE_CTRL              1
+#define MOTION_JPEG_TARGET_BYTES_PER_SEC   (150 * 1024)
+#define MOTION_JPEG_QUALITY_MIN            20
+#define MOTION_JPEG_QUALITY_MAX            80
+#define RATE_CTRL_LOG_FRAMES               0   // 1: log size, time and quality of every frame (takes UART time in the recording loop)
+
+/* buffers between the encoder and FileWriter task for movie recording (allocated from the FreeRTOS heap during recording) */
+/* the encoder waits only when all buffers are queued. check "stall" in the log after recording */
+#define MOVIE_WRITER_BUFF_NUM    4
+#define MOVIE_WRITER_BUFF_SIZE   (512 * 8)   // must be a multiple of sector size
+
+/* clusters for MOVIE_PREALLOC_SEC at MOTION_JPEG_TARGET_BYTES_PER_SEC are allocated when movie recording starts */
+/* (leaving MOVIE_PREALLOC_RESERVE on the card), and the rest is cut at finish. so FAT is not updated during recording */
+/* a longer movie just continues as usual after the area. 0 to disable */
+#define MOVIE_PREALLOC_SEC       60
+#define MOVIE_PREALLOC_RESERVE   (1024 * 1024)
+
+/* sizes in the AVI header are written to the card when movie recording starts and every MOVIE_SYNC_FRAMES frames (as time-lapse) */
+/* a preallocated file is longer than the frames, so playback after power loss relies on these sizes (frames after the last sync are lost) */
+#define MOVIE_SYNC_FRAMES        50
+
+/* movie pre-roll: during liveview, frames are encoded (RGB565, MOVIE_PREROLL_QUALITY, every MOVIE_FPS_MSEC) into a ring in RAM */
+/* when movie recording starts, frames in the ring are written first, so that the movie starts a few seconds before the key press */
+/* the ring takes the heap left during liveview (up to MOVIE_PREROLL_BUFF_MAX, leaving MOVIE_PREROLL_HEAP_MARGIN) */
+/* liveview becomes the preview of encoded frames (slower). it is a normal liveview if the ring cannot be allocated */
+/* check "evicted" and "dropped" in the log when recording starts, or by "preroll" command of debug monitor */
+#define MOVIE_PREROLL               0
+#define MOVIE_PREROLL_QUALITY       20
+#define MOVIE_PREROLL_FRAME_SIZE    (6 * 1024)    // space kept for the next frame. a larger frame is dropped
+#define MOVIE_PREROLL_BUFF_MAX      (48 * 1024)
+#define MOVIE_PREROLL_HEAP_MARGIN   (4 * 1024)
+
+/* time-lapse: OTHER0 key appends one frame (RGB565, current quality) every TIMELAPSE_INTERVAL_SEC to one AVI file instead of movie recording */
+/* the file is kept open until OTHER0 key is pressed again. the camera captures only one frame per interval */
+/* the file is synced every TIMELAPSE_SYNC_FRAMES frames so that it is playable even after power loss */
+/* 0 = disabled (normal movie). the interval can be changed by "lapse <sec>" command of debug monitor */
+#define TIMELAPSE_INTERVAL_SEC   0
+#define TIMELAPSE_PLAY_FPS_MSEC  100   // frame rate written to AVI header (played as 10fps)
+#define TIMELAPSE_SYNC_FRAMES    10
+
+/* burst shooting: pictures are taken continuously while the capture key is held */
+/* each picture is encoded into a RAM buffer, and written to the card by FileWriter task while the next picture is taken */
+/* buffers are allocated from the FreeRTOS heap as many as possible (up to BURST_BUFF_MAX_NUM), leaving BURST_HEAP_MARGIN */
+/* the first picture is encoded in the current quality, and the following ones in BURST_JPEG_QUALITY (if it is lower) */
+/* if the first picture doesn't fit in BURST_BUFF_SIZE, it is taken again in BURST_JPEG_QUALITY */
+/* a picture larger than BURST_BUFF_SIZE in BURST_JPEG_QUALITY is dropped (check "dropped" in the log after shooting) */
+#define BURST_CAPTURE         1
+#define BURST_JPEG_QUALITY    40
+#define BURST_BUFF_SIZE       (10 * 1024)
+#define BURST_BUFF_MAX_NUM    4
+#define BURST_HEAP_MARGIN     (2 * 1024)
+
+/* EXIF thumbnail (IMAGE_SIZE / 4 = 80 x 60) embedded in still pictures (single capture and burst), shown by playback before the main image */
+/* the thumbnail is made from the rows passed to the encoder (requires JPEG_ENCODE_RAW_YCBCR), and encoded after the main image */
+/* EXIF_APP1_SIZE bytes are reserved at the top of each picture and over-written when the thumbnail is ready */
+/* a thumbnail larger than the reserved area is omitted. the heap needs about 10KB more during capture (no thumbnail if not available) */
+#define EXIF_THUMBNAIL          1
+#define EXIF_THUMBNAIL_QUALITY  50
+#define EXIF_APP1_SIZE          (3 * 1024)
+
+/* lines passed to libjpeg at once (should be a multiple of MCU height (16 for YCbCr 4:2:0)) */
+/* heap budget for the strip buffer is IMAGE_SIZE_WIDTH * 3 * JPEG_ENCODE_STRIP_HEIGHT bytes (15KB for 320 x 16) */
+/* if it cannot be allocated, the strip height is halved until it fits */
+#define JPEG_ENCODE_STRIP_HEIGHT 16
+
+/* 1: convert pixels into YCbCr 4:2:0 by this application and pass them to libjpeg as raw data (skip jccolor.c and jcsample.c) */
+/* 0: pass RGB888 strips to libjpeg (JPEG_ENCODE_STRIP_HEIGHT is used only in this case) */
+/* raw data mode requires IMAGE_SIZE_WIDTH and IMAGE_SIZE_HEIGHT to be multiples of 16 */
+#define JPEG_ENCODE_RAW_YCBCR 1
+
+/* 1: capture a new frame for encoding into 2 SRAM strips by DCMI DMA (double buffer mode) */
+/*    each strip is encoded while the other one is being captured, then copied to the display (no readback from display) */
+/* 0: encode the frame which has been captured into the display (read back through FSMC) */
+/* the camera is slowed down by CAMERA_STRIP_CLOCK_DIV during strip capture, so that the encoder can keep up with it */
+/* if "strip overrun" is logged, increase CAMERA_STRIP_CLOCK_DIV */
+/* strip capture requires JPEG_ENCODE_RAW_YCBCR. 2 strips (IMAGE_SIZE_WIDTH * 2 * CAMERA_STRIP_LINES bytes each) are allocated from the heap */
+#define CAMERA_STRIP_CAPTURE    1
+#define CAMERA_STRIP_LINES      16    // must be a multiple of 16 (MCU height)
+#define CAMERA_STRIP_CLOCK_DIV  4
+
+/* memory region for libjpeg (all libjpeg allocations are taken from here instead of the FreeRTOS heap) */
+/* check the peak size by "jmem" command of debug monitor. if the region is not enough, the FreeRTOS heap is used */
+/* CCM RAM is not used by anything else, but cannot be accessed by DMA */
+#define JPEG_MEM_SIZE       (60 * 1024)
+#define JPEG_MEM_IN_CCMRAM  1
+
+/* 1: measure time of each encode stage (capture, convert, DCT, huffman, display, f_write, f_close) and SD block transfer */
+/* show and reset the result by "perf" command of debug monitor. 0 removes all measurement code */
+#define PERF_ENABLE  1
+
+/* data blocks of SD card are transferred by SPI DMA, and the task sleeps until the end (other tasks e.g. the encoder run meanwhile) */
+/* commands and small data are transferred by polling. so are blocks in CCM RAM (not accessible by DMA) and transfers before the kernel starts */
+/* compare "sdpoll" and "sddma" of "perf" command for CPU time per block */
+#define SD_SPI_DMA            1
+#define SD_SPI_DMA_MIN_SIZE   64
+#define SD_SPI_DMA_TIMEOUT    100   // msec
+
+/* write-back cache of SD card: writes of up to SD_WRITE_CACHE_MAX_COUNT sectors (FAT, directory, partial sectors) are kept in RAM */
+/* until the cache is full or FatFs syncs (f_sync, f_close). a rewrite of a cached sector (e.g. FAT) replaces it in RAM */
+/* adjacent sectors are written by one CMD25 (with ACMD23 pre-erase), and so are cached sectors just before a larger write */
+/* SD_WRITE_CACHE_SECTORS (512 bytes each, static RAM) = 0 writes every sector immediately */
+#define SD_WRITE_CACHE_SECTORS    8
+#define SD_WRITE_CACHE_MAX_COUNT  1
 
 #define FILENAME_JPEG      "IMG000.JPG"
 #define FILENAME_MOVIE     "IMG000.AVI"
+#define FILENAME_TIMELAPSE "LAP000.AVI"
 #define FILENAME_NUM_POS  3       // index number start at 3 (e.g. filename = IMG + 000)
 
+/* files are saved in DCF style folders (FILENAME_DIR_ROOT/100FILENAME_DIR_NAME - 999FILENAME_DIR_NAME) of 1000 files each */
+/* the next number is found by scanning the last folder once when liveview starts, then given without accessing the card */
+#define FILENAME_DIR_ROOT  "DCIM"
+#define FILENAME_DIR_NAME  "STM32"   // 5 characters
+#define FILENAME_PATH_SIZE 32        // e.g. "DCIM/100STM32/IMG000.JPG"
+
 #define BLACK_CURTAIN_TIME 200
 
+/* the pause mark in movie playback is erased after this time by decoding only the rows under it again (0 = keep it) */
+#define PLAYBACK_OSD_MSEC  1000
+
 #endif /* APPLICATIONSETTINGS_H_ */
@@ -14,6 +14,7 @@ typedef enum {
   LIVEVIEW_CTRL,
   PLAYBACK_CTRL,
   INPUT,
+  FILE_WRITER,
 } MODULE_ID;
 
 
@@ -44,7 +45,7 @@ typedef struct {
     uint32_t  val;
     struct {
       int16_t type;   // INPUT_TYPE
-      int16_t param; // only for dial (sensitivity at register, delta at notify)
+      int16_t param; // dial: sensitivity at register, delta at notify. key: 0 = pressed, 1 = released (only KEY_CAP notifies release)
     }input;
   }param;
 } MSG_STRUCT;
@@ -64,8 +64,14 @@
 /* Private functions ---------------------------------------------------------*/
 
 /*This defines the memory allocation methods.*/
-#define JMALLOC   pvPortMalloc
-#define JFREE     vPortFree
+/*libjpeg uses its own memory region instead of the FreeRTOS heap (Src/service/jpegMem.c)*/
+void *jpegMem_alloc(size_t size);
+void jpegMem_free(void *p);
+#define JMALLOC   jpegMem_alloc
+#define JFREE     jpegMem_free
+
+/*encode stages are measured by PERF_START/PERF_STOP (Src/service/perf.c)*/
+#include "perf.h"
 
 /*This defines the File data manager type.*/
 #define JFILE            FIL
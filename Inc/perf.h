@@ -0,0 +1,45 @@
+/*
+ * perf.h
+ *
+ *  Created on: 2017/09/22
+ *      Author: take-iwiw
+ */
+
+#ifndef PERF_H_
+#define PERF_H_
+
+#include <stdint.h>
+#include "applicationSettings.h"
+
+/* encode stages profiled by PERF_START / PERF_STOP (Src/service/perf.c) */
+/* SD stages are counted per data block (usually 512 bytes) in user_diskio.c */
+/* this header is also included from libjpeg (via jdata_conf.h) to measure DCT and huffman */
+typedef enum {
+  PERF_CAPTURE = 0,  // wait for strip DMA, or read back from display
+  PERF_CONVERT,      // RGB565/RGB888/YUV422 -> YCbCr
+  PERF_DCT,          // forward_DCT (incl. quantization)
+  PERF_HUFFMAN,      // encode_mcu (incl. f_write of still capture, which is called from the destination manager)
+  PERF_DISPLAY,      // preview
+  PERF_WRITE,        // f_write
+  PERF_CLOSE,        // f_close
+  PERF_SD_POLL,      // data block of SD card transferred by polling (CPU is busy during the transfer)
+  PERF_SD_DMA,       // data block of SD card transferred by DMA (only the start. the task sleeps during the transfer)
+  PERF_FRAME,        // whole frame (jpeg_start_compress - jpeg_finish_compress)
+  PERF_STAGE_NUM,
+} PERF_STAGE;
+
+#if PERF_ENABLE
+#define PERF_START(var)         uint32_t var = perf_getCount()
+#define PERF_STOP(stage, var)   perf_add(stage, var)
+#else
+#define PERF_START(var)
+#define PERF_STOP(stage, var)
+#endif
+
+void perf_init();
+uint32_t perf_getCount();
+void perf_add(PERF_STAGE stage, uint32_t startCount);
+void perf_show();
+void perf_reset();
+
+#endif /* PERF_H_ */
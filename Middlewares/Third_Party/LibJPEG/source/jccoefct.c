@@ -178,10 +178,12 @@ compress_data (j_compress_ptr cinfo, JSAMPIMAGE input_buf)
 	for (yindex = 0; yindex < compptr->MCU_height; yindex++) {
 	  if (coef->iMCU_row_num < last_iMCU_row ||
 	      yoffset+yindex < compptr->last_row_height) {
+	    PERF_START(perfStart);
 	    (*forward_DCT) (cinfo, compptr,
 			    input_buf[compptr->component_index],
 			    coef->MCU_buffer[blkn],
 			    ypos, xpos, (JDIMENSION) blockcnt);
+	    PERF_STOP(PERF_DCT, perfStart);
 	    if (blockcnt < compptr->MCU_width) {
 	      /* Create some dummy blocks at the right edge of the image. */
 	      FMEMZERO((void FAR *) coef->MCU_buffer[blkn + blockcnt],
@@ -205,12 +207,14 @@ compress_data (j_compress_ptr cinfo, JSAMPIMAGE input_buf)
       /* Try to write the MCU.  In event of a suspension failure, we will
        * re-DCT the MCU on restart (a bit inefficient, could be fixed...)
        */
+      PERF_START(perfStart);
       if (! (*cinfo->entropy->encode_mcu) (cinfo, coef->MCU_buffer)) {
 	/* Suspension forced; update state counters and exit */
 	coef->MCU_vert_offset = yoffset;
 	coef->mcu_ctr = MCU_col_num;
 	return FALSE;
       }
+      PERF_STOP(PERF_HUFFMAN, perfStart);
     }
     /* Completed an MCU row, but perhaps not an iMCU row */
     coef->mcu_ctr = 0;
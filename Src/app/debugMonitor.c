@@ -18,7 +18,13 @@
 #include "commonMsg.h"
 #include "ff.h"
 #include "jpeglib.h"
+#include "perf.h"
 #include "../driver/ov7670/ov7670.h"
+#include "../service/file.h"
+#include "../service/jpegMem.h"
+#include "../service/frameRing.h"
+
+extern void liveviewCtrl_setTimelapseInterval(uint32_t sec);
 
 
 
@@ -29,7 +35,6 @@ typedef struct {
 
 static RET enc(char *argv[], uint32_t argc)
 {
-  FATFS *p_fatFs = pvPortMalloc(sizeof(FATFS));
   FIL *p_fil = pvPortMalloc(sizeof(FIL));
   struct jpeg_compress_struct* p_cinfo = pvPortMalloc(sizeof(struct jpeg_compress_struct));
   struct jpeg_error_mgr* p_jerr = pvPortMalloc(sizeof(struct jpeg_error_mgr));
@@ -47,7 +52,7 @@ static RET enc(char *argv[], uint32_t argc)
   p_cinfo->err = jpeg_std_error(p_jerr);
   jpeg_create_compress(p_cinfo);
 
-  f_mount(p_fatFs, "", 0);
+  file_init();
   f_open(p_fil, "test.jpg", FA_WRITE | FA_CREATE_ALWAYS);
   jpeg_stdio_dest(p_cinfo, p_fil);
 
@@ -70,21 +75,17 @@ static RET enc(char *argv[], uint32_t argc)
   vPortFree(p_jerr);
   vPortFree(p_LineBuffRGB888);
   vPortFree(p_fil);
-  vPortFree(p_fatFs);
-
-  f_mount(0, "", 0);
 
   return RET_OK;
 }
 
 static RET ls(char *argv[], uint32_t argc)
 {
-  FATFS *p_fatFs = pvPortMalloc(sizeof(FATFS));
   DIR *p_dir = pvPortMalloc(sizeof(DIR));
   FRESULT ret;
   FILINFO fileinfo;
 
-  ret = f_mount(p_fatFs, "", 0);
+  ret = file_init();
   if(argc > 0) {
     ret = f_opendir(p_dir, argv[0]);
   } else {
@@ -103,28 +104,23 @@ static RET ls(char *argv[], uint32_t argc)
   }
 
   ret |= f_closedir(p_dir);
-  ret |= f_mount(0, "", 0);
 
   if(ret != RET_OK) printf("err: %d\n", ret);
 
   vPortFree(p_dir);
-  vPortFree(p_fatFs);
-
-  f_mount(0, "", 0);
 
   return RET_OK;
 }
 
 static RET fatfs(char *argv[], uint32_t argc)
 {
-  FATFS *p_fatFs = pvPortMalloc(sizeof(FATFS));
   FIL *p_fil = pvPortMalloc(sizeof(FIL));
   FRESULT ret;
   uint32_t n;
   uint8_t buff[4];
 
-  ret = f_mount(p_fatFs, "", 0);
-  printf("f_mount: %d\n", ret);
+  ret = file_init();
+  printf("file_init: %d\n", ret);
 
   ret = f_mkdir("aaa");
   printf("f_mkdir: %d\n", ret);
@@ -144,11 +140,10 @@ static RET fatfs(char *argv[], uint32_t argc)
   ret = f_read(p_fil, buff, 4, &n);
   printf("f_read: %d, %s\n", ret, buff);
 
-  ret = f_mount(0, "", 0);
-  printf("f_mount: %d\n", ret);
+  ret = f_close(p_fil);
+  printf("f_close: %d\n", ret);
 
   vPortFree(p_fil);
-  vPortFree(p_fatFs);
 
   return RET_OK;
 }
@@ -195,6 +190,44 @@ static RET mode(char *argv[], uint32_t argc)
   return RET_OK;
 }
 
+static RET jmem(char *argv[], uint32_t argc)
+{
+  printf("libjpeg memory: used = %d, peak = %d, fallback = %d\n", jpegMem_getUsedSize(), jpegMem_getPeakSize(), jpegMem_getFallbackCount());
+  if( (argc > 0) && (atoi(argv[0]) == 1) ) {  // "jmem 1" resets the peak after showing it
+    jpegMem_resetPeak();
+  }
+  return RET_OK;
+}
+
+static RET perf(char *argv[], uint32_t argc)
+{
+#if PERF_ENABLE
+  perf_show();
+  if( (argc > 0) && (atoi(argv[0]) == 1) ) {  // "perf 1" resets the result after showing it
+    perf_reset();
+  }
+#else
+  printf("PERF_ENABLE is 0\n");
+#endif
+  return RET_OK;
+}
+
+static RET lapse(char *argv[], uint32_t argc)
+{
+  /* "lapse 10": OTHER0 key in liveview starts time-lapse (one frame every 10 sec). "lapse 0": normal movie */
+  uint32_t sec = (argc > 0) ? atoi(argv[0]) : 0;
+  liveviewCtrl_setTimelapseInterval(sec);
+  printf("time-lapse interval = %d sec\n", sec);
+  return RET_OK;
+}
+
+static RET preroll(char *argv[], uint32_t argc)
+{
+  /* movie pre-roll ring (the last pre-roll when it is not running) */
+  frameRing_showStats();
+  return RET_OK;
+}
+
 static RET test1(char *argv[], uint32_t argc)
 {
   printf("test1\n");
@@ -223,6 +256,10 @@ DEBUG_MON_COMMAND s_debugCommands[] = {
   {"led",   led},
   {"cap",   cap},
   {"mode",  mode},
+  {"jmem",  jmem},
+  {"perf",  perf},
+  {"lapse", lapse},
+  {"preroll", preroll},
   {"test1", test1},
   {"test2", test2},
   {(void*)0, (void*)0},
@@ -5,47 +5,151 @@
  *      Author: take-iwiw
  */
 #include <stdio.h>
+#include <string.h>
+#include <setjmp.h>
 #include "cmsis_os.h"
 #include "ff.h"
 #include "jpeglib.h"
+#include "jerror.h"
 #include "common.h"
+#include "perf.h"
 #include "commonMsg.h"
 #include "applicationSettings.h"
 #include "../hal/display.h"
 #include "../hal/camera.h"
+#include "../service/avi.h"
+#include "../service/file.h"
+#include "../service/fileWriter.h"
+#include "../service/jpegFile.h"
+#include "../service/jpegMem.h"
+#include "../service/rateCtrl.h"
+#include "../service/jpegTable.h"
+#include "../service/ycbcr.h"
+#include "../service/exif.h"
+#include "../service/frameRing.h"
+#include "../service/fileNumber.h"
 
 
 /*** Internal Const Values, Macros ***/
 #define LOG(str, ...) printf("[LV_CTRL:%d] " str, __LINE__, ##__VA_ARGS__);
 #define LOG_E(str, ...) printf("[LV_CTRL_ERR:%d] " str, __LINE__, ##__VA_ARGS__);
 
-// need to modify jdatasrc.c
-#define INPUT_BUF_SIZE  512  /* choose an efficiently fread'able size */
+#if (JPEG_ENCODE_RAW_YCBCR || MOTION_JPEG_YUV422) && ((IMAGE_SIZE_WIDTH % 16 != 0) || (IMAGE_SIZE_HEIGHT % 16 != 0))
+#error "raw data encode requires the image size to be multiples of MCU size"
+#endif
+/* one MCU row of YCbCr 4:2:0 (Y: 16 lines, Cb, Cr: 8 lines), and 2 lines of RGB888 read from display */
+#define ENCODE_RAW_MCU_HEIGHT 16
+#define ENCODE_RAW_BUFF_SIZE  (IMAGE_SIZE_WIDTH * ENCODE_RAW_MCU_HEIGHT * 3 / 2 + IMAGE_SIZE_WIDTH * 3 * 2)
+/* one MCU row of YCbCr 4:2:2 (Y, Cb, Cr: 8 lines) or 4:2:0 from YUV422, and lines read from display at once */
+#define ENCODE_YUV_MCU_HEIGHT   ((MOTION_JPEG_YUV422 == 2) ? 16 : 8)
+#define ENCODE_YUV_READ_LINES   (ENCODE_YUV_MCU_HEIGHT / 8)
+#define ENCODE_YUV_BUFF_SIZE    (IMAGE_SIZE_WIDTH * ENCODE_YUV_MCU_HEIGHT + IMAGE_SIZE_WIDTH * 8 + IMAGE_SIZE_WIDTH * 3 * ENCODE_YUV_READ_LINES)
+#define ENCODE_MAX_ROWS ((JPEG_ENCODE_STRIP_HEIGHT > ENCODE_RAW_MCU_HEIGHT) ? JPEG_ENCODE_STRIP_HEIGHT : ENCODE_RAW_MCU_HEIGHT)
+
+#if CAMERA_STRIP_CAPTURE
+#if !JPEG_ENCODE_RAW_YCBCR
+#error "strip capture requires JPEG_ENCODE_RAW_YCBCR"
+#endif
+#if (CAMERA_STRIP_LINES % 16 != 0) || (IMAGE_SIZE_HEIGHT % CAMERA_STRIP_LINES != 0)
+#error "CAMERA_STRIP_LINES must be a multiple of 16 and a divisor of IMAGE_SIZE_HEIGHT"
+#endif
+/* 2 strips of 16-bit pixels from camera, and one MCU row of YCbCr (Y: 16 lines, Cb, Cr: 8 lines of W/2, or Y: 8 lines, Cb, Cr: 8 lines of W/2) */
+#define ENCODE_STRIP_SIZE       (IMAGE_SIZE_WIDTH * 2 * CAMERA_STRIP_LINES)
+#define ENCODE_STRIP_BUFF_SIZE  (ENCODE_STRIP_SIZE * 2 + IMAGE_SIZE_WIDTH * ENCODE_RAW_MCU_HEIGHT * 3 / 2)
+#define ENCODE_STRIP_TIMEOUT    (500 * CAMERA_STRIP_CLOCK_DIV)   // msec to wait for a strip
+#endif
+
+#define CAPTURE_FRAME_TIMEOUT  500   // msec to wait for vsync of the next frame (only when frames are read back from display)
+
+#if MOTION_JPEG_YUV422
+#define MOVIE_CAMERA_MODE   CAMERA_MODE_QVGA_YUV
+#define MOVIE_FPS_MSEC      MOTION_JPEG_FPS_MSEC_YUV422
+#else
+#define MOVIE_CAMERA_MODE   CAMERA_MODE_QVGA_RGB565
+#define MOVIE_FPS_MSEC      MOTION_JPEG_FPS_MSEC
+#endif
+
 
 typedef enum {
   INACTIVE,
   ACTIVE,
   SINGLE_CAPTURING,
   MOVIE_RECORDING,
+  BURST_CAPTURING,
+  TIMELAPSE_RECORDING,
 } STATUS;
 
+typedef enum {
+  ENCODE_DEST_FILE,     // write to sp_fil directly
+  ENCODE_DEST_WRITER,   // write through FileWriter task (fileWriter_start must be called)
+  ENCODE_DEST_MEM,      // write to a buffer set by jpegFile_setDestMem before each frame
+} ENCODE_DEST;
+
+/* libjpeg calls error_exit when it cannot continue (e.g. disk full). go back to the encoder by longjmp */
+typedef struct {
+  struct jpeg_error_mgr pub;
+  jmp_buf jmpBuf;
+} LIVEVIEW_JPEG_ERR;
+
 /*** Internal Static Variables ***/
 /* for status control */
 static STATUS s_status = INACTIVE;
-static uint8_t s_requestStopMovie = 0;  // movie record will stop at next frame
+static uint8_t s_requestStopMovie = 0;  // movie record (or time-lapse) will stop at next frame
 
 /* for encode */
-static uint8_t *sp_lineBuffRGB888;
-static FATFS   *sp_fatFs;
+static uint8_t *sp_stripBuff;
 static FIL     *sp_fil;
 static struct jpeg_compress_struct *sp_cinfo;
-static struct jpeg_error_mgr       *sp_jerr;
-static JSAMPROW s_jsamprow[2] = {0};
-static uint32_t s_jpegQuality = JPEG_QUALITY;
+static LIVEVIEW_JPEG_ERR           *sp_jerr;
+static JSAMPROW s_jsamprow[ENCODE_MAX_ROWS] = {0};
+static JSAMPROW s_jsamprowCb[8] = {0};
+static JSAMPROW s_jsamprowCr[8] = {0};
+static JSAMPARRAY s_jsampimage[3] = {s_jsamprow, s_jsamprowCb, s_jsamprowCr};
+static uint32_t s_jpegQualityLevel = JPEG_TABLE_LEVEL(JPEG_QUALITY);
+static uint32_t s_encodeQualityLevel;   // quality of the current frame (changed by rate control during movie recording)
+static uint32_t s_encodeCameraMode;
+static ENCODE_DEST s_encodeDest;
+static uint8_t  *sp_encodeMem;          // buffer set by jpegFile_setDestMem (ENCODE_DEST_MEM)
+static uint8_t  s_encodeThumbnail;      // 1: EXIF thumbnail is embedded in each picture
+#if !JPEG_ENCODE_RAW_YCBCR
+static uint32_t s_stripHeight;
+#endif
+#if CAMERA_STRIP_CAPTURE
+static volatile uint32_t s_stripCapturedNum;  // strips filled by DMA in the current frame
+static uint32_t s_stripOverrunNum;            // strips over-written by DMA before being encoded
+static uint32_t s_stripWaitMSec;              // time waiting for strips in the last frame (capture, not affected by quality)
+#endif
 
 /* for movie recording */
 static uint8_t s_nextFrameReady = 0;
 static uint32_t s_lastFrameStartTimeMSec = 0;
+#if MOVIE_SYNC_FRAMES > 0
+static uint32_t s_movieFrameNum;
+#endif
+
+#if MOVIE_PREROLL
+/* for movie pre-roll */
+static uint8_t s_isPrerolling = 0;  // liveview is drawn by encoding frames into the ring
+#endif
+
+/* for time-lapse */
+static uint32_t s_timelapseIntervalMSec = TIMELAPSE_INTERVAL_SEC * 1000;  // 0: OTHER0 key records a normal movie
+static uint32_t s_timelapseFrameNum;
+#if !CAMERA_STRIP_CAPTURE
+static uint8_t  s_timelapseCapturing;   // a frame is being copied from camera to display
+#endif
+
+#if BURST_CAPTURE
+/* for burst shooting */
+static uint8_t      s_requestStopBurst = 0;   // burst shooting will stop at next frame
+static uint8_t      *sp_burstBuff;            // slots of BURST_BUFF_SIZE
+static uint32_t     s_burstSlotNum;
+static char         s_burstFilenames[BURST_BUFF_MAX_NUM][FILENAME_PATH_SIZE];
+static osMessageQId s_burstFreeQueueId;       // slots which are not being written by FileWriter
+static uint32_t     s_burstShotNum;
+static uint32_t     s_burstDropNum;
+static uint32_t     s_burstStartMSec;
+#endif
 
 /*** Internal Function Declarations ***/
 static void liveviewCtrl_sendComp(MSG_STRUCT *p_recvMmsg, RET ret);
@@ -59,12 +163,43 @@ static RET liveviewCtrl_capture();
 static RET liveviewCtrl_movieRecordStart(); // call this when start movie recording
 static RET liveviewCtrl_movieRecordFinish();  // call this when stop movie recording
 static RET liveviewCtrl_movieRecordFrame(); // call this every frame during movie recording
+#if MOVIE_PREROLL
+static RET liveviewCtrl_prerollStart();   // call this instead of starting liveview
+static RET liveviewCtrl_prerollFinish(uint8_t keepFrames);
+static RET liveviewCtrl_prerollFrame();   // call this every frame during liveview
+static RET liveviewCtrl_prerollFlush();   // write frames in the ring to the movie
+#endif
+
+static RET liveviewCtrl_timelapseStart();
+static RET liveviewCtrl_timelapseFinish();
+static RET liveviewCtrl_timelapseFrame(); // call this every frame during time-lapse recording
 
+#if BURST_CAPTURE
+static RET liveviewCtrl_burstStart();   // call this when the capture key is pressed
+static RET liveviewCtrl_burstFinish();  // call this when the capture key is released
+static RET liveviewCtrl_burstFrame();   // call this every frame during burst shooting
+#endif
+
+static RET liveviewCtrl_encodeJpegStart(uint32_t cameraMode, ENCODE_DEST dest, uint8_t withThumbnail);  // create compressor. it is reused for all frames until liveviewCtrl_encodeJpegFinish
+static RET liveviewCtrl_encodeJpegFinish();
 static RET liveviewCtrl_encodeJpegFrame();  // call this between liveviewCtrl_writeFileStart and liveviewCtrl_writeFilefinish
+#if CAMERA_STRIP_CAPTURE
+static RET liveviewCtrl_writeJpegStrip();
+static void liveviewCtrl_cbStrip(uint32_t strip);
+#else
+#if JPEG_ENCODE_RAW_YCBCR
+static RET liveviewCtrl_writeJpegYCbCr420();
+#else
+static RET liveviewCtrl_writeJpegRGB888(uint32_t stripHeight);
+#endif
+static RET liveviewCtrl_writeJpegYUV();
+#endif
+static RET liveviewCtrl_writeThumbnail();
 static RET liveviewCtrl_writeFileStart(char* filename);
 static RET liveviewCtrl_writeFileFinish();
 static RET liveviewCtrl_generateFilename(char* filename, uint8_t numPos);
 static void liveviewCtrl_libjpeg_output_message (j_common_ptr cinfo);
+static void liveviewCtrl_libjpeg_error_exit (j_common_ptr cinfo);
 
 static void liveviewCtrl_cbVsync(uint32_t frame);
 static void liveviewCtrl_changeJpegQuality(int32_t delta);
@@ -74,6 +209,9 @@ void liveviewCtrl_task(void const * argument)
 {
   LOG("task start\n");
   osMessageQId myQueueId = getQueueId(LIVEVIEW_CTRL);
+#if PERF_ENABLE
+  perf_init();
+#endif
 
   while(1) {
     osEvent event;
@@ -89,6 +227,12 @@ void liveviewCtrl_task(void const * argument)
   }
 }
 
+/* 0 = normal movie by OTHER0 key. takes effect at the next start */
+void liveviewCtrl_setTimelapseInterval(uint32_t sec)
+{
+  s_timelapseIntervalMSec = sec * 1000;
+}
+
 /*** Internal Function Defines ***/
 static void liveviewCtrl_sendComp(MSG_STRUCT *p_recvMmsg, RET ret)
 {
@@ -140,11 +284,23 @@ static void liveviewCtrl_processMsg(MSG_STRUCT *p_msg)
     case CMD_NOTIFY_INPUT:
       LOG("input: %d %d\n", p_msg->param.input.type, p_msg->param.input.param);
       if(p_msg->param.input.type == INPUT_TYPE_KEY_CAP) {
+        if(p_msg->param.input.param != 0) break;  // released
+#if BURST_CAPTURE
+        if(liveviewCtrl_burstStart() == RET_OK) {
+          s_status = BURST_CAPTURING;
+          break;
+        }
+        /* not enough memory for burst shooting */
+#endif
         s_status = SINGLE_CAPTURING;
         liveviewCtrl_capture();
         s_status = ACTIVE;
       } else if(p_msg->param.input.type == INPUT_TYPE_KEY_OTHER0) {
-        if(liveviewCtrl_movieRecordStart() == RET_OK){
+        if(s_timelapseIntervalMSec > 0) {
+          if(liveviewCtrl_timelapseStart() == RET_OK){
+            s_status = TIMELAPSE_RECORDING;
+          }
+        } else if(liveviewCtrl_movieRecordStart() == RET_OK){
           s_status = MOVIE_RECORDING;
         }
       } else if(p_msg->param.input.type == INPUT_TYPE_DIAL0) {
@@ -167,6 +323,7 @@ static void liveviewCtrl_processMsg(MSG_STRUCT *p_msg)
     break;
 
   case MOVIE_RECORDING:
+  case TIMELAPSE_RECORDING:
     switch(p_msg->command){
     case CMD_START:
     case CMD_STOP:
@@ -185,6 +342,27 @@ static void liveviewCtrl_processMsg(MSG_STRUCT *p_msg)
     }
     break;
 
+#if BURST_CAPTURE
+  case BURST_CAPTURING:
+    switch(p_msg->command){
+    case CMD_START:
+    case CMD_STOP:
+      LOG("ignored mode change\n");
+      liveviewCtrl_sendComp(p_msg, RET_DO_NOTHING);
+      break;
+    case CMD_NOTIFY_INPUT:
+      if( (p_msg->param.input.type == INPUT_TYPE_KEY_CAP) && (p_msg->param.input.param != 0) ){
+        // stop burst shooting at next frame
+        s_requestStopBurst = 1;
+      }
+      break;
+    default:
+      LOG_E("status error\n");
+      break;
+    }
+    break;
+#endif
+
   default:
     LOG_E("status error\n");
     break;
@@ -206,6 +384,39 @@ static void liveviewCtrl_processFrame()
         s_requestStopMovie = 1; // stop by myself
       }
     }
+  } else if( s_status == TIMELAPSE_RECORDING ){
+    if(s_requestStopMovie) {
+      liveviewCtrl_timelapseFinish();
+      s_requestStopMovie = 0;
+      s_status = ACTIVE;
+    } else {
+      ret = liveviewCtrl_timelapseFrame();
+      if(ret != RET_OK) {
+        LOG_E("error during time-lapse: %08X\n", ret);
+        s_requestStopMovie = 1; // stop by myself
+      }
+    }
+#if MOVIE_PREROLL
+  } else if( (s_status == ACTIVE) && s_isPrerolling ){
+    liveviewCtrl_prerollFrame();
+#endif
+#if BURST_CAPTURE
+  } else if( s_status == BURST_CAPTURING ){
+    /* at least one picture is taken even if the key is released immediately */
+    if(s_requestStopBurst && (s_burstShotNum + s_burstDropNum > 0)) {
+      liveviewCtrl_burstFinish();
+      s_requestStopBurst = 0;
+      s_status = ACTIVE;
+    } else {
+      ret = liveviewCtrl_burstFrame();
+      if(ret != RET_OK) {
+        LOG_E("error during burst shooting: %08X\n", ret);
+        liveviewCtrl_burstFinish();
+        s_requestStopBurst = 0;
+        s_status = ACTIVE;
+      }
+    }
+#endif
   } else {
     // do nothing
   }
@@ -253,6 +464,9 @@ static RET liveviewCtrl_init()
     return RET_ERR;
   }
 
+  /*** scan file numbers now, not to delay the first picture (the card may have been changed in other modes) ***/
+  if( (file_init() != RET_OK) || (fileNumber_init() != RET_OK) ) LOG_E("no card?\n");   // scanned again at the first picture
+
   /*** start liveview ***/
   ret |= liveviewCtrl_startLiveView();
 
@@ -301,6 +515,9 @@ static RET liveviewCtrl_startLiveView()
 {
   RET ret = RET_OK;
   void* displayHandle = display_getDisplayHandle();
+#if MOVIE_PREROLL
+  if(liveviewCtrl_prerollStart() == RET_OK) return RET_OK;
+#endif
   camera_stopCap();
   display_setArea(0, 0, IMAGE_SIZE_WIDTH - 1, IMAGE_SIZE_HEIGHT - 1);
   ret |= camera_startCap(CAMERA_CAP_CONTINUOUS, displayHandle);
@@ -310,6 +527,9 @@ static RET liveviewCtrl_startLiveView()
 static RET liveviewCtrl_stopLiveView()
 {
   RET ret = RET_OK;
+#if MOVIE_PREROLL
+  if(s_isPrerolling) ret |= liveviewCtrl_prerollFinish(0);
+#endif
   ret |= camera_stopCap();
   return ret;
 }
@@ -318,15 +538,28 @@ static RET liveviewCtrl_capture()
 {
   LOG("Single Capture Start\n");
   RET ret = RET_OK;
-  char filename[14] = FILENAME_JPEG;
+  char filename[FILENAME_PATH_SIZE] = FILENAME_JPEG;
   uint32_t start = HAL_GetTick();
 
   ret |= liveviewCtrl_stopLiveView();
+#if CAMERA_STRIP_CAPTURE
+  /* a new frame is captured while encoding */
+  camera_setClockDivider(CAMERA_STRIP_CLOCK_DIV);
+#endif
   ret |= liveviewCtrl_generateFilename(filename, FILENAME_NUM_POS);
   LOG("create %s\n", filename);
   ret |= liveviewCtrl_writeFileStart(filename);
-  ret |= liveviewCtrl_encodeJpegFrame();
+  if(ret == RET_OK) {
+    ret |= liveviewCtrl_encodeJpegStart(CAMERA_MODE_QVGA_RGB565, ENCODE_DEST_FILE, 1);
+    if(ret == RET_OK) {
+      ret |= liveviewCtrl_encodeJpegFrame();
+      ret |= liveviewCtrl_encodeJpegFinish();
+    }
+  }
   ret |= liveviewCtrl_writeFileFinish();
+#if CAMERA_STRIP_CAPTURE
+  camera_setClockDivider(1);
+#endif
 
   LOG("encode time = %d\n", HAL_GetTick() - start);
   LOG("Single Capture Finish\n");
@@ -347,7 +580,13 @@ static RET liveviewCtrl_movieRecordStart()
 {
   LOG("Movie Record Start\n");
   RET ret = RET_OK;
-  char filename[14] = FILENAME_MOVIE;
+  char filename[FILENAME_PATH_SIZE] = FILENAME_MOVIE;
+  uint8_t isAviStarted = 0;   // FileWriter is running on sp_fil. it must be stopped before the file is closed
+#if MOVIE_PREROLL
+  /* frames in the ring are kept until they are written after the header */
+  uint8_t hasPreroll = s_isPrerolling;
+  if(hasPreroll) ret |= liveviewCtrl_prerollFinish(1);
+#endif
   ret |= liveviewCtrl_stopLiveView();
 
   s_nextFrameReady = 1; // the first frame is always ready because I can reuse liveview image
@@ -356,14 +595,64 @@ static RET liveviewCtrl_movieRecordStart()
   ret |= liveviewCtrl_generateFilename(filename, FILENAME_NUM_POS);
   LOG("create %s\n", filename);
   ret |= liveviewCtrl_writeFileStart(filename);
+#if MOVIE_PREALLOC_SEC > 0
+  if(ret == RET_OK) {
+    uint32_t allocSize;
+    ret |= file_preallocate(sp_fil, MOTION_JPEG_TARGET_BYTES_PER_SEC * MOVIE_PREALLOC_SEC, MOVIE_PREALLOC_RESERVE, &allocSize);
+    LOG("preallocated %d bytes\n", allocSize);
+  }
+#endif
+  if(ret == RET_OK) {
+    ret |= avi_writeStart(sp_fil, IMAGE_SIZE_WIDTH, IMAGE_SIZE_HEIGHT, MOVIE_FPS_MSEC, 0);
+    isAviStarted = (ret == RET_OK);
+  }
+#if MOVIE_PREROLL
+  if(hasPreroll) {
+    if(ret == RET_OK) ret |= liveviewCtrl_prerollFlush();   // on error, the file is closed below after avi_writeFinish
+    frameRing_finish();
+  }
+#endif
+#if MOVIE_SYNC_FRAMES > 0
+  s_movieFrameNum = 0;
+  if(ret == RET_OK) ret |= avi_writeSync();   // sizes for the frames so far, so that the rest of preallocated area is not read as frames
+#endif
+  if(ret == RET_OK) {
+    /* the compressor and buffers are kept during recording, so that no heap operation is needed per frame */
+    ret |= liveviewCtrl_encodeJpegStart(MOVIE_CAMERA_MODE, ENCODE_DEST_WRITER, 0);
+#if MOTION_JPEG_RATE_CTRL
+    rateCtrl_init(MOTION_JPEG_TARGET_BYTES_PER_SEC, MOVIE_FPS_MSEC,
+      JPEG_TABLE_LEVEL(MOTION_JPEG_QUALITY_MIN), JPEG_TABLE_LEVEL(MOTION_JPEG_QUALITY_MAX), s_jpegQualityLevel);
+    s_encodeQualityLevel = rateCtrl_getLevel();
+#endif
+  }
   if(ret != RET_OK) {
+    if(isAviStarted) avi_writeFinish();   // stop FileWriter and close AVIIDX.TMP
+#if MOVIE_PREALLOC_SEC > 0
+    if(sp_fil) file_truncate(sp_fil);
+#endif
     ret |= liveviewCtrl_writeFileFinish();
     LOG_E("Movie Record End by error: %08X\n", ret);
     return ret;
   }
 
+#if CAMERA_STRIP_CAPTURE
+  /* each frame is captured in liveviewCtrl_encodeJpegFrame, so a frame is always ready */
+#if MOTION_JPEG_YUV422
+  camera_config(MOVIE_CAMERA_MODE);
+#endif
+  camera_setClockDivider(CAMERA_STRIP_CLOCK_DIV);
+#else
   camera_registerCallback(0, liveviewCtrl_cbVsync);
 
+#if MOTION_JPEG_YUV422
+  /* the liveview image is RGB565, so capture the first frame again in YUV422 */
+  s_nextFrameReady = 0;
+  camera_config(MOVIE_CAMERA_MODE);
+  display_setArea(0, 0, IMAGE_SIZE_WIDTH - 1, IMAGE_SIZE_HEIGHT - 1);
+  ret |= camera_startCap(CAMERA_CAP_SINGLE_FRAME, display_getDisplayHandle());
+#endif
+#endif
+
   return ret;
 }
 
@@ -372,6 +661,14 @@ static RET liveviewCtrl_movieRecordFinish()
   RET ret = RET_OK;
 
   camera_registerCallback(0, 0);
+  ret |= liveviewCtrl_encodeJpegFinish();
+#if MOTION_JPEG_RATE_CTRL
+  rateCtrl_showStats();
+#endif
+  ret |= avi_writeFinish();
+#if MOVIE_PREALLOC_SEC > 0
+  ret |= file_truncate(sp_fil);   // avi_writeFinish leaves the position at the end of movie
+#endif
   ret |= liveviewCtrl_writeFileFinish();
 
 #if BLACK_CURTAIN_TIME > 0
@@ -380,6 +677,12 @@ static RET liveviewCtrl_movieRecordFinish()
   HAL_Delay(BLACK_CURTAIN_TIME);
 #endif
 
+#if MOTION_JPEG_YUV422
+  camera_config(CAMERA_MODE_QVGA_RGB565);
+#endif
+#if CAMERA_STRIP_CAPTURE
+  camera_setClockDivider(1);
+#endif
   ret |= liveviewCtrl_startLiveView();
   if(ret != RET_OK) {
     LOG_E("Movie Encode End by error: %08X\n", ret);
@@ -394,16 +697,34 @@ static RET liveviewCtrl_movieRecordFrame()
   RET ret = RET_OK;
 
   if(s_nextFrameReady) {
-    if(HAL_GetTick() - s_lastFrameStartTimeMSec > MOTION_JPEG_FPS_MSEC) { // control fps
+    if(HAL_GetTick() - s_lastFrameStartTimeMSec > MOVIE_FPS_MSEC) { // control fps
       LOG("Movie One Frame Encode. Current FPS(msec) = %d\n", HAL_GetTick() - s_lastFrameStartTimeMSec);
       s_lastFrameStartTimeMSec = HAL_GetTick();
-      /* encode one frame (do not close file yet) */
+      /* encode one frame as a chunk of AVI (do not close file yet) */
+      uint32_t framePos = fileWriter_tell();
+      ret |= avi_writeFrameStart();
       ret |= liveviewCtrl_encodeJpegFrame();
+      ret |= avi_writeFrameFinish();
+#if MOTION_JPEG_RATE_CTRL
+      /* decide quality of the next frame from size and encode + write time of this frame */
+      /* the frame is still being written by FileWriter, so the time includes only waiting for free buffers */
+      uint32_t busyMSec = HAL_GetTick() - s_lastFrameStartTimeMSec;
+#if CAMERA_STRIP_CAPTURE
+      /* the slowed capture takes most of the frame time (e.g. 80msec at 1/4), and a lower quality cannot shorten it */
+      busyMSec -= s_stripWaitMSec;
+#endif
+      s_encodeQualityLevel = rateCtrl_update(fileWriter_tell() - framePos, busyMSec);
+#endif
+#if MOVIE_SYNC_FRAMES > 0
+      if(++s_movieFrameNum % MOVIE_SYNC_FRAMES == 0) ret |= avi_writeSync();
+#endif
+#if !CAMERA_STRIP_CAPTURE
       /* capture next frame */
       void* displayHandle = display_getDisplayHandle();
       display_setArea(0, 0, IMAGE_SIZE_WIDTH - 1, IMAGE_SIZE_HEIGHT - 1);
       ret |= camera_startCap(CAMERA_CAP_SINGLE_FRAME, displayHandle);
       s_nextFrameReady = 0;
+#endif
     } else {
       // skip for fps control
     }
@@ -411,7 +732,7 @@ static RET liveviewCtrl_movieRecordFrame()
     /* not ready (copying image data from camera to display) */
 
     // workaround. Vsync signal sometimes doesn't come (probably because of poor hardware work)
-    if(HAL_GetTick() - s_lastFrameStartTimeMSec > MOTION_JPEG_FPS_MSEC*3) {
+    if(HAL_GetTick() - s_lastFrameStartTimeMSec > MOVIE_FPS_MSEC*3) {
       LOG_E("frame lost\n");
       s_nextFrameReady = 1;
     }
@@ -420,128 +741,780 @@ static RET liveviewCtrl_movieRecordFrame()
   return ret;
 }
 
-static void liveviewCtrl_cbVsync(uint32_t frame)
+#if MOVIE_PREROLL
+/* liveview by encoding frames into the ring. the ring takes the heap left after the encoder is ready */
+static RET liveviewCtrl_prerollStart()
 {
+  RET ret;
+
   camera_stopCap();
+  ret = liveviewCtrl_encodeJpegStart(CAMERA_MODE_QVGA_RGB565, ENCODE_DEST_MEM, 0);
+  if(ret != RET_OK) return ret;
+
+  size_t freeSize = xPortGetFreeHeapSize();
+  uint32_t ringSize = (freeSize > MOVIE_PREROLL_HEAP_MARGIN) ? freeSize - MOVIE_PREROLL_HEAP_MARGIN : 0;
+  if(ringSize > MOVIE_PREROLL_BUFF_MAX) ringSize = MOVIE_PREROLL_BUFF_MAX;
+  if( (ringSize < MOVIE_PREROLL_FRAME_SIZE * 2) || (frameRing_start(ringSize) != RET_OK) ) {
+    LOG_E("no pre-roll (free heap = %d)\n", freeSize);
+    liveviewCtrl_encodeJpegFinish();
+    return RET_ERR_MEMORY;
+  }
+  LOG("pre-roll ring = %d bytes\n", ringSize);
+
+  s_encodeQualityLevel = JPEG_TABLE_LEVEL(MOVIE_PREROLL_QUALITY);
+  s_isPrerolling = 1;
   s_nextFrameReady = 1;
+  s_lastFrameStartTimeMSec = HAL_GetTick() - MOVIE_FPS_MSEC;
+#if CAMERA_STRIP_CAPTURE
+  camera_setClockDivider(CAMERA_STRIP_CLOCK_DIV);
+#else
+  /* the first frame is captured by liveviewCtrl_prerollFrame */
+  s_nextFrameReady = 0;
+  s_lastFrameStartTimeMSec = HAL_GetTick();
+  camera_registerCallback(0, liveviewCtrl_cbVsync);
+  display_setArea(0, 0, IMAGE_SIZE_WIDTH - 1, IMAGE_SIZE_HEIGHT - 1);
+  camera_startCap(CAMERA_CAP_SINGLE_FRAME, display_getDisplayHandle());
+#endif
+
+  return RET_OK;
 }
 
-static RET liveviewCtrl_encodeJpegFrame()
+/* keepFrames = 1: the ring is kept for liveviewCtrl_prerollFlush (frameRing_finish must be called after it) */
+static RET liveviewCtrl_prerollFinish(uint8_t keepFrames)
+{
+  RET ret = RET_OK;
+
+  camera_registerCallback(0, 0);
+  camera_stopCap();
+  ret |= liveviewCtrl_encodeJpegFinish();
+#if CAMERA_STRIP_CAPTURE
+  camera_setClockDivider(1);
+#endif
+  if(!keepFrames) frameRing_finish();
+  s_isPrerolling = 0;
+
+  return ret;
+}
+
+static RET liveviewCtrl_prerollFrame()
+{
+  RET ret;
+  uint32_t size;
+
+  if(!s_nextFrameReady) {
+    /* not ready (copying image data from camera to display) */
+    if(HAL_GetTick() - s_lastFrameStartTimeMSec > MOVIE_FPS_MSEC*3) {
+      LOG_E("frame lost\n");
+      s_nextFrameReady = 1;
+    }
+    return RET_OK;
+  }
+  if(HAL_GetTick() - s_lastFrameStartTimeMSec < MOVIE_FPS_MSEC) return RET_OK;  // control fps
+  s_lastFrameStartTimeMSec = HAL_GetTick();
+
+  /* the oldest frames are overwritten. a frame larger than the space given is dropped */
+  sp_encodeMem = frameRing_getWriteBuffer(MOVIE_PREROLL_FRAME_SIZE, &size);
+  jpegFile_setDestMem(sp_cinfo, sp_encodeMem, size);
+  ret = liveviewCtrl_encodeJpegFrame();
+  frameRing_commit((ret == RET_OK) ? jpegFile_getDestMemSize(sp_cinfo) : 0, s_lastFrameStartTimeMSec);
+
+#if !CAMERA_STRIP_CAPTURE
+  /* capture next frame */
+  display_setArea(0, 0, IMAGE_SIZE_WIDTH - 1, IMAGE_SIZE_HEIGHT - 1);
+  ret |= camera_startCap(CAMERA_CAP_SINGLE_FRAME, display_getDisplayHandle());
+  s_nextFrameReady = 0;
+#endif
+
+  return ret;
+}
+
+/* write frames in the ring as the first frames of the movie (call this after avi_writeStart) */
+static RET liveviewCtrl_prerollFlush()
+{
+  RET ret = RET_OK;
+  uint8_t *p_data;
+  uint32_t size, timeMSec;
+  uint32_t frameNum = 0;
+  uint32_t firstMSec = HAL_GetTick();
+
+  frameRing_showStats();
+  /* stop at an error. the caller finishes the AVI writer before closing the file, and the rest of the ring is discarded */
+  while( (ret == RET_OK) && (frameRing_pop(&p_data, &size, &timeMSec) == RET_OK) ) {
+    if(frameNum == 0) firstMSec = timeMSec;
+    ret |= avi_writeFrameStart();
+    for(uint32_t pos = 0; pos < size; pos += fileWriter_getBufferSize()) {
+      uint32_t writeSize = (size - pos < fileWriter_getBufferSize()) ? size - pos : fileWriter_getBufferSize();
+      ret |= fileWriter_writeData(0, p_data + pos, writeSize);
+    }
+    ret |= avi_writeFrameFinish();
+    frameNum++;
+  }
+  /* the frame rate of the movie includes the pre-roll */
+  avi_writeSetStartTime(firstMSec);
+  LOG("pre-roll: %d frames, %d msec\n", frameNum, HAL_GetTick() - firstMSec);
+
+  return ret;
+}
+#endif
+
+static RET liveviewCtrl_timelapseStart()
+{
+  LOG("Time-lapse Start (every %d msec)\n", s_timelapseIntervalMSec);
+  RET ret = RET_OK;
+  char filename[FILENAME_PATH_SIZE] = FILENAME_TIMELAPSE;
+  ret |= liveviewCtrl_stopLiveView();
+
+  ret |= liveviewCtrl_generateFilename(filename, FILENAME_NUM_POS);
+  LOG("create %s\n", filename);
+  ret |= liveviewCtrl_writeFileStart(filename);
+  if(ret == RET_OK) {
+    ret |= avi_writeStart(sp_fil, IMAGE_SIZE_WIDTH, IMAGE_SIZE_HEIGHT, TIMELAPSE_PLAY_FPS_MSEC, 1);
+  }
+  if(ret == RET_OK) {
+    ret |= liveviewCtrl_encodeJpegStart(CAMERA_MODE_QVGA_RGB565, ENCODE_DEST_WRITER, 0);
+    if(ret != RET_OK) avi_writeFinish();  // stop FileWriter
+  }
+  if(ret != RET_OK) {
+    ret |= liveviewCtrl_writeFileFinish();
+    LOG_E("Time-lapse End by error: %08X\n", ret);
+    liveviewCtrl_startLiveView();
+    return ret;
+  }
+
+  s_timelapseFrameNum = 0;
+  s_nextFrameReady = 1; // the first frame is the liveview image (or a new frame is captured while encoding)
+  s_lastFrameStartTimeMSec = HAL_GetTick() - s_timelapseIntervalMSec;
+#if CAMERA_STRIP_CAPTURE
+  camera_setClockDivider(CAMERA_STRIP_CLOCK_DIV);
+#else
+  s_timelapseCapturing = 0;
+  camera_registerCallback(0, liveviewCtrl_cbVsync);
+#endif
+
+  return ret;
+}
+
+static RET liveviewCtrl_timelapseFinish()
+{
+  RET ret = RET_OK;
+
+  camera_registerCallback(0, 0);
+  camera_stopCap();
+  ret |= liveviewCtrl_encodeJpegFinish();
+  ret |= avi_writeFinish();
+  ret |= liveviewCtrl_writeFileFinish();
+
+#if CAMERA_STRIP_CAPTURE
+  camera_setClockDivider(1);
+#endif
+  ret |= liveviewCtrl_startLiveView();
+  if(ret != RET_OK) {
+    LOG_E("Time-lapse End by error: %08X\n", ret);
+  }
+  LOG("Time-lapse Finish (%d frames)\n", s_timelapseFrameNum);
+
+  return ret;
+}
+
+/* the camera is stopped between frames (the last frame stays on display). a new frame is captured when the interval has passed */
+static RET liveviewCtrl_timelapseFrame()
 {
   RET ret = RET_OK;
 
+  if(HAL_GetTick() - s_lastFrameStartTimeMSec < s_timelapseIntervalMSec) return RET_OK;
+
+#if !CAMERA_STRIP_CAPTURE
+  if(!s_nextFrameReady) {
+    if(!s_timelapseCapturing) {
+      display_setArea(0, 0, IMAGE_SIZE_WIDTH - 1, IMAGE_SIZE_HEIGHT - 1);
+      ret |= camera_startCap(CAMERA_CAP_SINGLE_FRAME, display_getDisplayHandle());
+      s_timelapseCapturing = 1;
+    } else if(HAL_GetTick() - s_lastFrameStartTimeMSec > s_timelapseIntervalMSec + CAPTURE_FRAME_TIMEOUT) {
+      LOG_E("frame lost\n");
+      s_nextFrameReady = 1;
+    }
+    return ret;
+  }
+  s_nextFrameReady = 0;
+  s_timelapseCapturing = 0;
+#endif
+
+  /* keep the interval even if a frame is delayed, unless it has been delayed more than one interval */
+  s_lastFrameStartTimeMSec += s_timelapseIntervalMSec;
+  if(HAL_GetTick() - s_lastFrameStartTimeMSec >= s_timelapseIntervalMSec) s_lastFrameStartTimeMSec = HAL_GetTick();
+
+  uint32_t framePos = fileWriter_tell();
+  ret |= avi_writeFrameStart();
+  ret |= liveviewCtrl_encodeJpegFrame();
+  ret |= avi_writeFrameFinish();
+  s_timelapseFrameNum++;
+  LOG("time-lapse frame %d: %d bytes\n", s_timelapseFrameNum, fileWriter_tell() - framePos);
+  if(s_timelapseFrameNum % TIMELAPSE_SYNC_FRAMES == 0) {
+    ret |= avi_writeSync();
+  }
+
+  return ret;
+}
+
+#if BURST_CAPTURE
+static RET liveviewCtrl_burstStart()
+{
+  LOG("Burst Start\n");
+  RET ret = RET_OK;
+
+  /* stop liveview first, because it may be using the encoder and the heap (pre-roll) */
+  /* liveview is restarted by single capture if burst shooting cannot start */
+  ret |= liveviewCtrl_stopLiveView();
+
+  if(s_burstFreeQueueId == 0) {
+    osMessageQDef(BurstFree, BURST_BUFF_MAX_NUM, uint32_t);
+    s_burstFreeQueueId = osMessageCreate(osMessageQ(BurstFree), NULL);
+    if(s_burstFreeQueueId == 0) return RET_ERR_MEMORY;
+  }
+
+  /* check the volume before creating the encoder. after that, the encoder is released on every failure */
+  ret |= file_init();
+  if(ret != RET_OK) return ret;
+  ret |= liveviewCtrl_encodeJpegStart(CAMERA_MODE_QVGA_RGB565, ENCODE_DEST_MEM, 1);   // released by itself on error
+  if(ret != RET_OK) return ret;
+  ret |= fileWriter_start(0);
+  if(ret != RET_OK) {
+    liveviewCtrl_encodeJpegFinish();
+    return ret;
+  }
+
+  /* take slots as many as the heap allows. try fewer slots if the heap is fragmented */
+  size_t freeSize = xPortGetFreeHeapSize();
+  s_burstSlotNum = (freeSize > BURST_HEAP_MARGIN) ? (freeSize - BURST_HEAP_MARGIN) / BURST_BUFF_SIZE : 0;
+  if(s_burstSlotNum > BURST_BUFF_MAX_NUM) s_burstSlotNum = BURST_BUFF_MAX_NUM;
+  sp_burstBuff = 0;
+  while( (s_burstSlotNum > 0) && ((sp_burstBuff = pvPortMalloc(BURST_BUFF_SIZE * s_burstSlotNum)) == 0) ) {
+    s_burstSlotNum--;
+  }
+  if(sp_burstBuff == 0) {
+    LOG_E("not enough memory (free heap = %d)\n", freeSize);
+    fileWriter_finish();
+    liveviewCtrl_encodeJpegFinish();
+    return RET_ERR_MEMORY;
+  }
+  for(uint32_t i = 0; i < s_burstSlotNum; i++) {
+    osMessagePut(s_burstFreeQueueId, (uint32_t)(sp_burstBuff + BURST_BUFF_SIZE * i), 0);
+  }
+  LOG("burst slots = %d x %d bytes\n", s_burstSlotNum, BURST_BUFF_SIZE);
+
+  s_burstShotNum = 0;
+  s_burstDropNum = 0;
+  s_burstStartMSec = HAL_GetTick();
+  s_nextFrameReady = 1; // the first frame is always ready because I can reuse liveview image (or a new frame is captured while encoding)
+  s_lastFrameStartTimeMSec = HAL_GetTick();
+#if CAMERA_STRIP_CAPTURE
+  camera_setClockDivider(CAMERA_STRIP_CLOCK_DIV);
+#else
+  camera_registerCallback(0, liveviewCtrl_cbVsync);
+#endif
+
+  return ret;
+}
+
+static RET liveviewCtrl_burstFinish()
+{
+  RET ret = RET_OK;
+  uint32_t time = HAL_GetTick() - s_burstStartMSec + 1;
+
+  camera_registerCallback(0, 0);
+  ret |= liveviewCtrl_encodeJpegFinish();
+  ret |= fileWriter_finish();   // wait until all pictures are written
+  LOG("burst: %d shots (%d dropped) in %d msec, %d.%02d shots/sec (%d msec including write)\n",
+    s_burstShotNum, s_burstDropNum, time, s_burstShotNum * 1000 / time, (s_burstShotNum * 100000 / time) % 100, HAL_GetTick() - s_burstStartMSec);
+
+  /* all slots have been returned by FileWriter */
+  while(osMessageGet(s_burstFreeQueueId, 0).status == osEventMessage);
+  vPortFree(sp_burstBuff);
+  sp_burstBuff = 0;
+
+#if BLACK_CURTAIN_TIME > 0
+  camera_stopCap();
+  display_drawRect(0, 0, IMAGE_SIZE_WIDTH, IMAGE_SIZE_HEIGHT, DISPLAY_COLOR_BLACK);  // like shutter
+  HAL_Delay(BLACK_CURTAIN_TIME);
+#endif
+
+#if CAMERA_STRIP_CAPTURE
+  camera_setClockDivider(1);
+#endif
+  ret |= liveviewCtrl_startLiveView();
+  if(ret != RET_OK) {
+    LOG_E("Burst End by error: %08X\n", ret);
+  }
+  LOG("Burst Finish\n");
+
+  return ret;
+}
+
+static RET liveviewCtrl_burstFrame()
+{
+  RET ret = RET_OK;
+
+  if(!s_nextFrameReady) {
+    /* not ready (copying image data from camera to display) */
+    if(HAL_GetTick() - s_lastFrameStartTimeMSec > CAPTURE_FRAME_TIMEOUT) {
+      LOG_E("frame lost\n");
+      s_nextFrameReady = 1;
+    }
+    return RET_OK;
+  }
+
+  /* wait for a slot which has been written to the card */
+  uint8_t *p_slot = osMessageGet(s_burstFreeQueueId, osWaitForever).value.p;
+  char *filename = s_burstFilenames[(p_slot - sp_burstBuff) / BURST_BUFF_SIZE];
+  strcpy(filename, FILENAME_JPEG);
+  ret = fileNumber_getNext(filename, FILENAME_NUM_POS);
+  if(ret != RET_OK) {
+    osMessagePut(s_burstFreeQueueId, (uint32_t)p_slot, 0);
+    return ret;
+  }
+
+  s_lastFrameStartTimeMSec = HAL_GetTick();
+  jpegFile_setDestMem(sp_cinfo, p_slot, BURST_BUFF_SIZE);
+  sp_encodeMem = p_slot;
+  sp_jerr->pub.msg_code = 0;  // to tell an overflow of the slot from other errors
+  ret = liveviewCtrl_encodeJpegFrame();
+  if( (ret != RET_OK) && (sp_jerr->pub.msg_code == JERR_BUFFER_SIZE) && (s_encodeQualityLevel > JPEG_TABLE_LEVEL(BURST_JPEG_QUALITY)) ) {
+    /* the first picture in the current quality is too large. take it again in the burst quality */
+    LOG("%s is too large in quality %d. retry\n", filename, (s_encodeQualityLevel + 1) * JPEG_TABLE_QUALITY_STEP);
+    s_encodeQualityLevel = JPEG_TABLE_LEVEL(BURST_JPEG_QUALITY);
+    ret = liveviewCtrl_encodeJpegFrame();
+  }
+  /* the following pictures are taken in the burst quality to keep shots/sec and RAM usage */
+  if(s_encodeQualityLevel > JPEG_TABLE_LEVEL(BURST_JPEG_QUALITY)) s_encodeQualityLevel = JPEG_TABLE_LEVEL(BURST_JPEG_QUALITY);
+
+  if(ret == RET_OK) {
+    uint32_t size = jpegFile_getDestMemSize(sp_cinfo);
+    LOG("%s: %d bytes, %d msec\n", filename, size, HAL_GetTick() - s_lastFrameStartTimeMSec);
+    ret = fileWriter_saveFile(filename, p_slot, size, s_burstFreeQueueId);   // the slot comes back when written
+    s_burstShotNum++;
+  } else {
+    osMessagePut(s_burstFreeQueueId, (uint32_t)p_slot, 0);
+    if(sp_jerr->pub.msg_code == JERR_BUFFER_SIZE) {
+      LOG_E("%s is larger than %d bytes. dropped\n", filename, BURST_BUFF_SIZE);
+      s_burstDropNum++;
+      ret = RET_OK;
+    }
+  }
+
+#if !CAMERA_STRIP_CAPTURE
+  /* capture next frame */
+  void* displayHandle = display_getDisplayHandle();
+  display_setArea(0, 0, IMAGE_SIZE_WIDTH - 1, IMAGE_SIZE_HEIGHT - 1);
+  ret |= camera_startCap(CAMERA_CAP_SINGLE_FRAME, displayHandle);
+  s_nextFrameReady = 0;
+#endif
+
+  return ret;
+}
+#endif
+
+static void liveviewCtrl_cbVsync(uint32_t frame)
+{
+  camera_stopCap();
+  s_nextFrameReady = 1;
+}
+
+/* dest = ENCODE_DEST_WRITER: output is written by FileWriter task (fileWriter_start must have been called) */
+/* withThumbnail = 1: EXIF thumbnail is embedded (RGB565 only) */
+static RET liveviewCtrl_encodeJpegStart(uint32_t cameraMode, ENCODE_DEST dest, uint8_t withThumbnail)
+{
+  s_encodeCameraMode   = cameraMode;
+  s_encodeDest         = dest;
+  s_encodeQualityLevel = s_jpegQualityLevel;
+
   /*** alloc memory ***/
   sp_cinfo = pvPortMalloc(sizeof(struct jpeg_compress_struct));
-  sp_jerr  = pvPortMalloc(sizeof(struct jpeg_error_mgr));
-  sp_lineBuffRGB888 = pvPortMalloc(IMAGE_SIZE_WIDTH * 3);
+  sp_jerr  = pvPortMalloc(sizeof(LIVEVIEW_JPEG_ERR));
+#if CAMERA_STRIP_CAPTURE
+  sp_stripBuff = pvPortMalloc(ENCODE_STRIP_BUFF_SIZE);  // must be in DMA accessible RAM
+#else
+  if(cameraMode == CAMERA_MODE_QVGA_YUV) {
+    sp_stripBuff = pvPortMalloc(ENCODE_YUV_BUFF_SIZE);
+  } else {
+#if JPEG_ENCODE_RAW_YCBCR
+    sp_stripBuff = pvPortMalloc(ENCODE_RAW_BUFF_SIZE);
+#else
+    /* try smaller strip if heap is not enough */
+    s_stripHeight = JPEG_ENCODE_STRIP_HEIGHT;
+    do {
+      sp_stripBuff = pvPortMalloc(IMAGE_SIZE_WIDTH * 3 * s_stripHeight);
+    } while( (sp_stripBuff == 0) && ((s_stripHeight /= 2) > 0) );
+#endif
+  }
+#endif
 
-  if( (sp_cinfo == 0) || (sp_jerr == 0) || (sp_lineBuffRGB888 == 0) ){
+  if( (sp_cinfo == 0) || (sp_jerr == 0) || (sp_stripBuff == 0) ){
     LOG_E("not enough memory\n");
     vPortFree(sp_cinfo);
     vPortFree(sp_jerr);
-    vPortFree(sp_lineBuffRGB888);
+    vPortFree(sp_stripBuff);
+    sp_cinfo = 0;
     return RET_ERR_MEMORY;
   }
 
   /*** prepare libjpeg ***/
-  s_jsamprow[0] = sp_lineBuffRGB888;
-  sp_cinfo->err = jpeg_std_error(sp_jerr);
+  sp_cinfo->err = jpeg_std_error(&sp_jerr->pub);
   sp_cinfo->err->output_message = liveviewCtrl_libjpeg_output_message;  // over-write error output function
+  sp_cinfo->err->error_exit = liveviewCtrl_libjpeg_error_exit;
+  if(setjmp(sp_jerr->jmpBuf)) {
+    LOG_E("Encode Setting Error\n");
+    liveviewCtrl_encodeJpegFinish();
+    return RET_ERR;
+  }
   jpeg_create_compress(sp_cinfo);
-  jpeg_stdio_dest(sp_cinfo, sp_fil);
+  if(dest == ENCODE_DEST_WRITER) {
+    jpegFile_setDestWriter(sp_cinfo);
+  } else if(dest == ENCODE_DEST_MEM) {
+    jpegFile_setDestMem(sp_cinfo, 0, 0);
+  } else {
+    jpegFile_setDest(sp_cinfo, sp_fil);
+  }
 
-  /* jpeg encode setting */
+  /* jpeg encode setting. these are kept by the compress object after jpeg_finish_compress */
   sp_cinfo->image_width  = IMAGE_SIZE_WIDTH;
   sp_cinfo->image_height = IMAGE_SIZE_HEIGHT;
   sp_cinfo->input_components = 3;
-  sp_cinfo->in_color_space = JCS_RGB;
-  jpeg_set_defaults(sp_cinfo);
-  jpeg_set_quality(sp_cinfo, s_jpegQuality, TRUE);
-  jpeg_start_compress(sp_cinfo, TRUE);
+  if(cameraMode == CAMERA_MODE_QVGA_YUV) {
+    sp_cinfo->in_color_space = JCS_YCbCr;
+    jpeg_set_defaults(sp_cinfo);
+    if(ENCODE_YUV_MCU_HEIGHT == 8) sp_cinfo->comp_info[0].v_samp_factor = 1;   // YCbCr 4:2:2 (Y: 2x1, Cb: 1x1, Cr: 1x1)
+  } else {
+    sp_cinfo->in_color_space = JCS_RGB;
+    jpeg_set_defaults(sp_cinfo);    // YCbCr 4:2:0 (Y: 2x2, Cb: 1x1, Cr: 1x1)
+  }
+  sp_cinfo->restart_in_rows = JPEG_RESTART_ROWS;
+  if( (cameraMode == CAMERA_MODE_QVGA_YUV) || JPEG_ENCODE_RAW_YCBCR ) {
+    sp_cinfo->raw_data_in = TRUE;
+    sp_cinfo->do_fancy_downsampling = FALSE;  // otherwise libjpeg expects full size Cb, Cr and downsamples them by 16x16 DCT
+  }
 
-  /*** read pixel data from display and encode line by line ***/
-  display_setAreaRead(0, 0, IMAGE_SIZE_WIDTH - 1, IMAGE_SIZE_HEIGHT - 1);
-  for(uint32_t y = 0; y < IMAGE_SIZE_HEIGHT; y++) {
-    /* read one line from display device (as an external RAM) */
-    display_readImageRGB888(sp_lineBuffRGB888, IMAGE_SIZE_WIDTH);
-    /* encode one line */
-    if(jpeg_write_scanlines(sp_cinfo, s_jsamprow, 1) != 1) {
-      LOG_E("Single Encode Stop at line %d\n", y);
-      break;
-    }
+  s_encodeThumbnail = 0;
+#if EXIF_THUMBNAIL
+  /* the picture is saved without thumbnail if the heap is not enough */
+  if( withThumbnail && (cameraMode == CAMERA_MODE_QVGA_RGB565) && (exif_start() == RET_OK) ) {
+    s_encodeThumbnail = 1;
+    sp_cinfo->write_JFIF_header = FALSE;  // APP1 (EXIF) must be the first segment after SOI
   }
+#endif
+
+  return RET_OK;
+}
+
+static RET liveviewCtrl_encodeJpegFinish()
+{
+  if(sp_cinfo == 0) return RET_OK;  // not started, or already finished by error
 
-  /*** finalize libjpeg ***/
-  jpeg_finish_compress(sp_cinfo);
   jpeg_destroy_compress(sp_cinfo);
+  exif_finish();
+  s_encodeThumbnail = 0;
+  LOG("libjpeg memory peak = %d (fallback = %d)\n", jpegMem_getPeakSize(), jpegMem_getFallbackCount());
 
   /*** free memory ***/
   vPortFree(sp_cinfo);
   vPortFree(sp_jerr);
-  vPortFree(sp_lineBuffRGB888);
+  vPortFree(sp_stripBuff);
+  sp_cinfo = 0;
 
-  return ret;
+  return RET_OK;
 }
 
-static RET liveviewCtrl_writeFileStart(char* filename)
+static RET liveviewCtrl_encodeJpegFrame()
 {
   RET ret = RET_OK;
-  sp_fatFs = pvPortMalloc(sizeof(FATFS));
-  sp_fil   = pvPortMalloc(sizeof(FIL));
-  if( (sp_fatFs == 0) || (sp_fil == 0) ) {
-    return RET_ERR_MEMORY;
+
+  if(setjmp(sp_jerr->jmpBuf)) {
+    /* libjpeg stopped by error (e.g. disk full). the compress object can be used again after abort */
+    LOG_E("Encode Abort\n");
+#if CAMERA_STRIP_CAPTURE
+    camera_stopCap();
+#endif
+    jpeg_abort_compress(sp_cinfo);
+    return RET_ERR_FILE;
   }
 
-  ret |= f_mount(sp_fatFs, "", 0);
-  ret |= f_open(sp_fil, filename, FA_WRITE | FA_CREATE_NEW);
+  PERF_START(perfFrame);
 
+  /* every frame must be a complete JPEG (each AVI chunk is decoded independently), so write all tables */
+  jpegTable_setQuality(sp_cinfo, s_encodeQualityLevel);
+  jpeg_start_compress(sp_cinfo, TRUE);
+  if(s_encodeThumbnail) exif_writeApp1(sp_cinfo);
+
+#if CAMERA_STRIP_CAPTURE
+  /*** capture a new frame and encode ***/
+  ret |= liveviewCtrl_writeJpegStrip();
+#else
+  /*** read pixel data from display and encode ***/
+  if(s_encodeCameraMode == CAMERA_MODE_QVGA_YUV) {
+    ret |= liveviewCtrl_writeJpegYUV();
+  } else {
+#if JPEG_ENCODE_RAW_YCBCR
+    ret |= liveviewCtrl_writeJpegYCbCr420();
+#else
+    ret |= liveviewCtrl_writeJpegRGB888(s_stripHeight);
+#endif
+  }
+#endif
+
+  /*** finalize libjpeg ***/
+  if(ret == RET_OK) {
+    jpeg_finish_compress(sp_cinfo);
+    if(s_encodeThumbnail) ret |= liveviewCtrl_writeThumbnail();
+  } else {
+    jpeg_abort_compress(sp_cinfo);
+  }
+
+  PERF_STOP(PERF_FRAME, perfFrame);
   return ret;
 }
 
-static RET liveviewCtrl_writeFileFinish()
+#if CAMERA_STRIP_CAPTURE
+/*
+ * capture a new frame into 2 strips by DMA, and encode each strip while the other one is being captured
+ * RGB565 is converted into YCbCr 4:2:0, YUV422 is unpacked into YCbCr 4:2:2 (or 4:2:0)
+ * each strip is copied to the display after encoded (Y as grayscale for YUV422)
+ */
+static RET liveviewCtrl_writeJpegStrip()
 {
-  RET ret = RET_OK;
-  ret |= f_close(sp_fil);
-  ret |= f_mount(0, "", 0);
-  vPortFree(sp_fil);
-  vPortFree(sp_fatFs);
-  return ret;
+  /* buffer layout: strip[2][W*LINES] (16-bit pixels), Y[16][W], Cb[8][W/2], Cr[8][W/2] */
+  uint16_t *p_strip[2];
+  p_strip[0] = (uint16_t*)sp_stripBuff;
+  p_strip[1] = (uint16_t*)(sp_stripBuff + ENCODE_STRIP_SIZE);
+  uint8_t *p_ycbcr = sp_stripBuff + ENCODE_STRIP_SIZE * 2;
+  uint8_t isYUV = (s_encodeCameraMode == CAMERA_MODE_QVGA_YUV);
+  uint32_t mcuHeight = isYUV ? ENCODE_YUV_MCU_HEIGHT : ENCODE_RAW_MCU_HEIGHT;
+  for(uint32_t i = 0; i < mcuHeight; i++) {
+    s_jsamprow[i] = p_ycbcr + IMAGE_SIZE_WIDTH * i;
+  }
+  for(uint32_t i = 0; i < 8; i++) {
+    s_jsamprowCb[i] = p_ycbcr + IMAGE_SIZE_WIDTH * mcuHeight + (IMAGE_SIZE_WIDTH / 2) * i;
+    s_jsamprowCr[i] = p_ycbcr + IMAGE_SIZE_WIDTH * mcuHeight + (IMAGE_SIZE_WIDTH / 2) * (i + 8);
+  }
+
+  s_stripCapturedNum = 0;
+  if(camera_startCapStrip(p_strip[0], p_strip[1], ENCODE_STRIP_SIZE, liveviewCtrl_cbStrip) != RET_OK) {
+    return RET_ERR;
+  }
+
+  s_stripWaitMSec = 0;
+  for(uint32_t strip = 0; strip < IMAGE_SIZE_HEIGHT / CAMERA_STRIP_LINES; strip++) {
+    PERF_START(perfCapture);
+    uint32_t start = HAL_GetTick();
+    while(s_stripCapturedNum <= strip) {
+      if(HAL_GetTick() - start > ENCODE_STRIP_TIMEOUT) {
+        camera_stopCap();
+        LOG_E("strip %d timeout (camera DMA error = %d)\n", strip, camera_getDmaErrorNum());
+        return RET_ERR_TIMEOUT;
+      }
+      osDelay(1);
+    }
+    s_stripWaitMSec += HAL_GetTick() - start;
+    PERF_STOP(PERF_CAPTURE, perfCapture);
+
+    uint16_t *p_pixel = p_strip[strip % 2];
+    for(uint32_t y = 0; y < CAMERA_STRIP_LINES; y += mcuHeight) {
+      PERF_START(perfConvert);
+      for(uint32_t i = 0; i < mcuHeight; i += 2) {
+        const uint16_t *p_line = p_pixel + IMAGE_SIZE_WIDTH * (y + i);
+        if(!isYUV) {
+          ycbcr_convertRGB565To420(p_line, IMAGE_SIZE_WIDTH, s_jsamprow[i], s_jsamprow[i + 1], s_jsamprowCb[i / 2], s_jsamprowCr[i / 2]);
+        } else if(mcuHeight == 16) {
+          ycbcr_unpackYUV422PixelTo420(p_line, IMAGE_SIZE_WIDTH, s_jsamprow[i], s_jsamprow[i + 1], s_jsamprowCb[i / 2], s_jsamprowCr[i / 2]);
+        } else {
+          ycbcr_unpackYUV422Pixel(p_line, IMAGE_SIZE_WIDTH, s_jsamprow[i], s_jsamprowCb[i], s_jsamprowCr[i]);
+          ycbcr_unpackYUV422Pixel(p_line + IMAGE_SIZE_WIDTH, IMAGE_SIZE_WIDTH, s_jsamprow[i + 1], s_jsamprowCb[i + 1], s_jsamprowCr[i + 1]);
+        }
+      }
+      PERF_STOP(PERF_CONVERT, perfConvert);
+      if(s_encodeThumbnail) exif_addRows(s_jsampimage, strip * CAMERA_STRIP_LINES + y);   // never set for YUV422
+      if(jpeg_write_raw_data(sp_cinfo, s_jsampimage, mcuHeight) != mcuHeight) {
+        LOG_E("Single Encode Stop at line %d\n", strip * CAMERA_STRIP_LINES + y);
+        camera_stopCap();
+        return RET_ERR;
+      }
+    }
+
+    /* preview */
+    PERF_START(perfDisplay);
+    if(isYUV) ycbcr_convertYUV422ToRGB565Gray(p_pixel, IMAGE_SIZE_WIDTH * CAMERA_STRIP_LINES, p_pixel);
+    display_setArea(0, strip * CAMERA_STRIP_LINES, IMAGE_SIZE_WIDTH - 1, (strip + 1) * CAMERA_STRIP_LINES - 1);
+    display_writeImage(p_pixel, IMAGE_SIZE_WIDTH * CAMERA_STRIP_LINES);
+    PERF_STOP(PERF_DISPLAY, perfDisplay);
+
+    /* DMA has started to write the next strip into this buffer before it is released */
+    if(s_stripCapturedNum > strip + 1) s_stripOverrunNum++;
+  }
+  camera_stopCap();
+
+  if(s_stripOverrunNum > 0) {
+    LOG_E("strip overrun = %d\n", s_stripOverrunNum);
+    s_stripOverrunNum = 0;
+  }
+  if(camera_getDmaErrorNum() > 0) {
+    LOG_E("camera DMA error = %d\n", camera_getDmaErrorNum());
+  }
+  return RET_OK;
 }
 
-static RET liveviewCtrl_generateFilename(char* filename, uint8_t numPos)
+static void liveviewCtrl_cbStrip(uint32_t strip)
+{
+  s_stripCapturedNum = strip + 1;
+}
+#else
+#if JPEG_ENCODE_RAW_YCBCR
+/* convert RGB888 into YCbCr 4:2:0 and pass them to libjpeg as raw data */
+static RET liveviewCtrl_writeJpegYCbCr420()
 {
-  static uint8_t s_number = 0;
+  /* buffer layout: Y[16][W], Cb[8][W/2], Cr[8][W/2], RGB888[2][W*3] */
+  for(uint32_t i = 0; i < ENCODE_RAW_MCU_HEIGHT; i++) {
+    s_jsamprow[i] = sp_stripBuff + IMAGE_SIZE_WIDTH * i;
+  }
+  for(uint32_t i = 0; i < ENCODE_RAW_MCU_HEIGHT / 2; i++) {
+    s_jsamprowCb[i] = sp_stripBuff + IMAGE_SIZE_WIDTH * ENCODE_RAW_MCU_HEIGHT + (IMAGE_SIZE_WIDTH / 2) * i;
+    s_jsamprowCr[i] = sp_stripBuff + IMAGE_SIZE_WIDTH * ENCODE_RAW_MCU_HEIGHT * 5 / 4 + (IMAGE_SIZE_WIDTH / 2) * i;
+  }
+  uint8_t *p_lineBuffRGB888 = sp_stripBuff + IMAGE_SIZE_WIDTH * ENCODE_RAW_MCU_HEIGHT * 3 / 2;
 
-  FRESULT ret;
-  FATFS *p_fatFs = pvPortMalloc(sizeof(FATFS));
-  FIL   *p_fil   = pvPortMalloc(sizeof(FIL));
-  if( (p_fatFs == 0) || (p_fil == 0) ) {
-    vPortFree(p_fil);
-    vPortFree(p_fatFs);
-    return RET_ERR_MEMORY;
+  display_setAreaRead(0, 0, IMAGE_SIZE_WIDTH - 1, IMAGE_SIZE_HEIGHT - 1);
+  for(uint32_t y = 0; y < IMAGE_SIZE_HEIGHT; y += ENCODE_RAW_MCU_HEIGHT) {
+    for(uint32_t i = 0; i < ENCODE_RAW_MCU_HEIGHT; i += 2) {
+      PERF_START(perfCapture);
+      display_readImageRGB888(p_lineBuffRGB888, IMAGE_SIZE_WIDTH * 2);
+      PERF_STOP(PERF_CAPTURE, perfCapture);
+      PERF_START(perfConvert);
+      ycbcr_convertRGB888To420(p_lineBuffRGB888, IMAGE_SIZE_WIDTH, s_jsamprow[i], s_jsamprow[i + 1], s_jsamprowCb[i / 2], s_jsamprowCr[i / 2]);
+      PERF_STOP(PERF_CONVERT, perfConvert);
+    }
+    if(s_encodeThumbnail) exif_addRows(s_jsampimage, y);
+    if(jpeg_write_raw_data(sp_cinfo, s_jsampimage, ENCODE_RAW_MCU_HEIGHT) != ENCODE_RAW_MCU_HEIGHT) {
+      LOG_E("Single Encode Stop at line %d\n", y);
+      return RET_ERR;
+    }
+  }
+  return RET_OK;
+}
+#else
+/* pass RGB888 strips to libjpeg, which converts them into YCbCr and downsamples */
+static RET liveviewCtrl_writeJpegRGB888(uint32_t stripHeight)
+{
+  for(uint32_t i = 0; i < stripHeight; i++) {
+    s_jsamprow[i] = sp_stripBuff + IMAGE_SIZE_WIDTH * 3 * i;
   }
 
-  f_mount(p_fatFs, "", 0);
-  do {
-    uint8_t num100 = (s_number/100) % 10;
-    uint8_t num10  = (s_number/10) % 10;
-    uint8_t num1   = (s_number/1) % 10;
-    filename[numPos + 0] = '0' + num100;
-    filename[numPos + 1] = '0' + num10;
-    filename[numPos + 2] = '0' + num1;
-    s_number++;
-    ret = f_open(p_fil, filename, FA_OPEN_EXISTING);
-    f_close(p_fil);
-  } while(ret == FR_OK);
+  display_setAreaRead(0, 0, IMAGE_SIZE_WIDTH - 1, IMAGE_SIZE_HEIGHT - 1);
+  for(uint32_t y = 0; y < IMAGE_SIZE_HEIGHT; y += stripHeight) {
+    uint32_t lines = (IMAGE_SIZE_HEIGHT - y < stripHeight) ? IMAGE_SIZE_HEIGHT - y : stripHeight;
+    /* read lines from display device (as an external RAM) at once */
+    PERF_START(perfCapture);
+    display_readImageRGB888(sp_stripBuff, IMAGE_SIZE_WIDTH * lines);
+    PERF_STOP(PERF_CAPTURE, perfCapture);
+    /* encode lines (whole MCU rows are processed in one call) */
+    if(jpeg_write_scanlines(sp_cinfo, s_jsamprow, lines) != lines) {
+      LOG_E("Single Encode Stop at line %d\n", y);
+      return RET_ERR;
+    }
+  }
+  return RET_OK;
+}
+#endif
 
-  f_mount(0, "", 0);
-  vPortFree(p_fil);
-  vPortFree(p_fatFs);
+/* pass YUV422 from camera to libjpeg as raw data without color conversion */
+/* the display shows YUV422 as RGB565, so overwrite it with Y (grayscale) as preview */
+static RET liveviewCtrl_writeJpegYUV()
+{
+  /* buffer layout: Y[8 or 16][W], Cb[8][W/2], Cr[8][W/2], lines[1 or 2][W*3] */
+  for(uint32_t i = 0; i < ENCODE_YUV_MCU_HEIGHT; i++) {
+    s_jsamprow[i] = sp_stripBuff + IMAGE_SIZE_WIDTH * i;
+  }
+  for(uint32_t i = 0; i < 8; i++) {
+    s_jsamprowCb[i] = sp_stripBuff + IMAGE_SIZE_WIDTH * ENCODE_YUV_MCU_HEIGHT + (IMAGE_SIZE_WIDTH / 2) * i;
+    s_jsamprowCr[i] = sp_stripBuff + IMAGE_SIZE_WIDTH * ENCODE_YUV_MCU_HEIGHT + (IMAGE_SIZE_WIDTH / 2) * (i + 8);
+  }
+  uint8_t *p_lineBuff = sp_stripBuff + IMAGE_SIZE_WIDTH * ENCODE_YUV_MCU_HEIGHT + IMAGE_SIZE_WIDTH * 8;
+
+  for(uint32_t y = 0; y < IMAGE_SIZE_HEIGHT; y += ENCODE_YUV_MCU_HEIGHT) {
+    display_setAreaRead(0, y, IMAGE_SIZE_WIDTH - 1, y + ENCODE_YUV_MCU_HEIGHT - 1);
+    for(uint32_t i = 0; i < ENCODE_YUV_MCU_HEIGHT; i += ENCODE_YUV_READ_LINES) {
+      PERF_START(perfCapture);
+      display_readImageRGB888(p_lineBuff, IMAGE_SIZE_WIDTH * ENCODE_YUV_READ_LINES);
+      PERF_STOP(PERF_CAPTURE, perfCapture);
+      PERF_START(perfConvert);
+#if MOTION_JPEG_YUV422 == 2
+      ycbcr_unpackYUV422To420(p_lineBuff, IMAGE_SIZE_WIDTH, s_jsamprow[i], s_jsamprow[i + 1], s_jsamprowCb[i / 2], s_jsamprowCr[i / 2]);
+#else
+      ycbcr_unpackYUV422(p_lineBuff, IMAGE_SIZE_WIDTH, s_jsamprow[i], s_jsamprowCb[i], s_jsamprowCr[i]);
+#endif
+      PERF_STOP(PERF_CONVERT, perfConvert);
+    }
+    if(jpeg_write_raw_data(sp_cinfo, s_jsampimage, ENCODE_YUV_MCU_HEIGHT) != ENCODE_YUV_MCU_HEIGHT) {
+      LOG_E("Single Encode Stop at line %d\n", y);
+      return RET_ERR;
+    }
+    /* preview */
+    PERF_START(perfDisplay);
+    display_setArea(0, y, IMAGE_SIZE_WIDTH - 1, y + ENCODE_YUV_MCU_HEIGHT - 1);
+    for(uint32_t i = 0; i < ENCODE_YUV_MCU_HEIGHT; i++) {
+      ycbcr_convertYToRGB565(s_jsamprow[i], IMAGE_SIZE_WIDTH, (uint16_t*)p_lineBuff);
+      display_writeImage(p_lineBuff, IMAGE_SIZE_WIDTH);
+    }
+    PERF_STOP(PERF_DISPLAY, perfDisplay);
+  }
+  return RET_OK;
+}
+#endif
 
-  if(ret == FR_NO_FILE) {
-      return RET_OK;
+/* encode the thumbnail after the main image, and over-write APP1 reserved at the top of the picture */
+static RET liveviewCtrl_writeThumbnail()
+{
+  RET ret = RET_OK;
+  const uint8_t *p_app1 = exif_encodeThumbnail(sp_cinfo, JPEG_TABLE_LEVEL(EXIF_THUMBNAIL_QUALITY));
+
+  if(s_encodeDest == ENCODE_DEST_MEM) {
+    memcpy(sp_encodeMem + EXIF_APP1_POS, p_app1, EXIF_APP1_SIZE);
+  } else {
+    UINT num;
+    DWORD end = f_tell(sp_fil);
+    PERF_START(perfWrite);
+    ret |= f_lseek(sp_fil, EXIF_APP1_POS);
+    ret |= f_write(sp_fil, p_app1, EXIF_APP1_SIZE, &num);
+    ret |= f_lseek(sp_fil, end);
+    PERF_STOP(PERF_WRITE, perfWrite);
+    if( (ret != RET_OK) || (num != EXIF_APP1_SIZE) ) {
+      LOG_E("thumbnail write error\n");
+      ret |= RET_ERR_FILE;
+    }
   }
-  return RET_ERR;
+  return ret;
+}
+
+/* the volume is kept mounted after the file is closed */
+static RET liveviewCtrl_writeFileStart(char* filename)
+{
+  FRESULT ret = file_open(&sp_fil, filename, FA_WRITE | FA_CREATE_NEW);
+  if(ret == FR_EXIST) fileNumber_reset();   // e.g. the card has been changed. scan it again at the next picture
+  return ret;
+}
+
+static RET liveviewCtrl_writeFileFinish()
+{
+  RET ret = RET_OK;
+  PERF_START(perfClose);
+  ret |= file_close(sp_fil);
+  PERF_STOP(PERF_CLOSE, perfClose);
+  sp_fil = 0;
+  return ret;
+}
+
+/* the card is accessed only the first time, or for a new folder */
+static RET liveviewCtrl_generateFilename(char* filename, uint8_t numPos)
+{
+  RET ret = file_init();
+  if(ret == RET_OK) ret = fileNumber_getNext(filename, numPos);
+  return ret;
 }
 
 void display_readImageRGB565(uint8_t *p_buff, uint32_t pixelNum)
@@ -588,14 +1561,22 @@ static void liveviewCtrl_libjpeg_output_message (j_common_ptr cinfo)
   printf( "%s\n", buffer);
 }
 
+static void liveviewCtrl_libjpeg_error_exit (j_common_ptr cinfo)
+{
+  LIVEVIEW_JPEG_ERR *p_err = (LIVEVIEW_JPEG_ERR *)cinfo->err;
+  (*cinfo->err->output_message) (cinfo);
+  longjmp(p_err->jmpBuf, 1);
+}
+
 static void liveviewCtrl_changeJpegQuality(int32_t delta)
 {
-  s_jpegQuality += (delta * 10);
-  if(s_jpegQuality > 100) s_jpegQuality = 100;
-  if(s_jpegQuality < 1) s_jpegQuality = 1;
-  LOG("Q = %d\n", s_jpegQuality);
+  int32_t level = (int32_t)s_jpegQualityLevel + delta;
+  if(level >= JPEG_TABLE_LEVEL_NUM) level = JPEG_TABLE_LEVEL_NUM - 1;
+  if(level < 0) level = 0;
+  s_jpegQualityLevel = level;
+  LOG("Q = %d\n", jpegTable_getQuality(s_jpegQualityLevel));
   liveviewCtrl_stopLiveView();
-  display_osdBar(s_jpegQuality);
+  display_osdBar(jpegTable_getQuality(s_jpegQualityLevel));
   HAL_Delay(300);
   liveviewCtrl_startLiveView();
 
@@ -5,6 +5,8 @@
  *      Author: take-iwiw
  */
 #include <stdio.h>
+#include <string.h>
+#include <setjmp.h>
 #include "cmsis_os.h"
 #include "ff.h"
 #include "jpeglib.h"
@@ -13,15 +15,15 @@
 #include "applicationSettings.h"
 #include "../hal/display.h"
 #include "../service/file.h"
+#include "../service/avi.h"
+#include "../service/jpegFile.h"
+#include "../service/exif.h"
 
 
 /*** Internal Const Values, Macros ***/
 #define LOG(str, ...) printf("[PB_CTRL:%d] " str, __LINE__, ##__VA_ARGS__);
 #define LOG_E(str, ...) printf("[PB_CTRL_ERR:%d] " str, __LINE__, ##__VA_ARGS__);
 
-// need to modify jdatasrc.c
-#define INPUT_BUF_SIZE  512  /* choose an efficiently fread'able size */
-
 typedef enum {
   INACTIVE,
   ACTIVE,
@@ -29,13 +31,25 @@ typedef enum {
   MOVIE_PAUSE,
 } STATUS;
 
+/* libjpeg calls error_exit when it cannot continue (e.g. broken file). go back to the decoder by longjmp */
+typedef struct {
+  struct jpeg_error_mgr pub;
+  jmp_buf jmpBuf;
+} PLAYBACK_JPEG_ERR;
+
 /*** Internal Static Variables ***/
 static STATUS s_status = INACTIVE;
+static char    s_currentFilename[FILENAME_PATH_SIZE];
+static uint8_t s_isBrowsing = 0;    // 1: show only the EXIF thumbnail of JPEG files (if any) to browse files quickly
 
 // for motion jpeg
 static FIL     *sp_movieFil;
+static uint8_t  s_isMovieAvi;             // 1: frames are located by AVI index, 0: just concatenated JPEG files
 static uint32_t s_lastFrameStartTimeMSec; // for fps control
 static uint32_t s_currentTargetFPS;
+static uint32_t s_movieFrameOffset;       // file position of the frame on the display (AVI)
+static uint32_t s_pauseStartTimeMSec;
+static uint8_t  s_isPauseMarkShown;
 
 /*** Internal Function Declarations ***/
 static void playbackCtrl_sendComp(MSG_STRUCT *p_recvMmsg, RET ret);
@@ -44,6 +58,7 @@ static void playbackCtrl_processFrame();
 static RET playbackCtrl_init();
 static RET playbackCtrl_exit();
 static RET playbackCtrl_playNext(); // call this when dial rotated
+static RET playbackCtrl_playFile(char* filename);
 
 static RET playbackCtrl_isFileJPEG(char *filename);
 static RET playbackCtrl_isFileRGB565(char *filename);
@@ -55,11 +70,14 @@ static RET playbackCtrl_playJPEG(char* filename);
 static RET playbackCtrl_playMotionJPEGStart(char* filename);
 static RET playbackCtrl_playMotionJPEGStop();
 static RET playbackCtrl_playMotionJPEGNext();
+static RET playbackCtrl_erasePauseMark();
 
-static RET playbackCtrl_decodeJpeg(FIL *p_file, uint32_t maxWidth, uint32_t maxHeight);
+static RET playbackCtrl_findThumbnail(FIL *p_file, uint32_t *p_offset);
+static RET playbackCtrl_decodeJpeg(FIL *p_file, uint32_t maxWidth, uint32_t maxHeight, uint8_t isFit, uint32_t yStart, uint32_t yEnd);
 static void playbackCtrl_libjpeg_output_message (j_common_ptr cinfo);
-static void playbackCtrl_drawRGB888 (uint8_t* rgb888, uint32_t width);
-static RET playbackCtrl_calcJpegOutputSize(struct jpeg_decompress_struct* p_cinfo, uint32_t maxWidth, uint32_t maxHeight);
+static void playbackCtrl_libjpeg_error_exit (j_common_ptr cinfo);
+static void playbackCtrl_drawRGB888 (uint8_t* rgb888, uint32_t width, uint32_t zoom);
+static RET playbackCtrl_calcJpegOutputSize(struct jpeg_decompress_struct* p_cinfo, uint32_t maxWidth, uint32_t maxHeight, uint32_t *p_zoom);
 
 
 /*** External Function Defines ***/
@@ -147,8 +165,15 @@ static void playbackCtrl_processMsg(MSG_STRUCT *p_msg)
         if(s_status == MOVIE_PLAYING) {
           s_status = MOVIE_PAUSE;
           display_osdMark(DISPLAY_OSD_TYPE_PAUSE);
+          s_pauseStartTimeMSec = HAL_GetTick();
+          s_isPauseMarkShown = 1;
         } else if(s_status == MOVIE_PAUSE) {
           s_status = MOVIE_PLAYING;
+        } else {
+          /* still image: switch browse mode, and show the current file again */
+          s_isBrowsing = !s_isBrowsing;
+          LOG("browse mode = %d\n", s_isBrowsing);
+          if(s_currentFilename[0] != '\0') playbackCtrl_playFile(s_currentFilename);
         }
       }
       break;
@@ -170,6 +195,11 @@ static void playbackCtrl_processFrame()
     } else {
       // skip for fps control
     }
+  } else if( (s_status == MOVIE_PAUSE) && s_isPauseMarkShown ) {
+    if( (PLAYBACK_OSD_MSEC > 0) && (HAL_GetTick() - s_pauseStartTimeMSec > PLAYBACK_OSD_MSEC) ) {
+      playbackCtrl_erasePauseMark();
+      s_isPauseMarkShown = 0;
+    }
   } else {
     /* do nothing */
   }
@@ -234,9 +264,8 @@ static RET playbackCtrl_exit()
     ret |= playbackCtrl_playMotionJPEGStop();
   }
 
-  /*** exit file ***/
+  /*** exit file (the volume is kept mounted for other modes) ***/
   ret |= file_seekStop();
-  ret |= file_deinit();
 
   if(ret != RET_OK) LOG_E("%08X\n", ret);
 
@@ -246,7 +275,7 @@ static RET playbackCtrl_exit()
 static RET playbackCtrl_playNext()
 {
   RET ret = RET_OK;
-  char filename[16];
+  char filename[FILENAME_PATH_SIZE];
 
   /* exit movie play if playing */
   if( (s_status == MOVIE_PLAYING) || (s_status == MOVIE_PAUSE) ) {
@@ -256,12 +285,8 @@ static RET playbackCtrl_playNext()
   /* search for the next iamge file to be displayed */
   ret = file_seekFileNext(filename);
   if(ret == RET_OK) {
-    LOG("play %s\n", filename);
-    display_drawRect(0, 0, IMAGE_SIZE_WIDTH, IMAGE_SIZE_HEIGHT, DISPLAY_COLOR_BLACK);  // background
-    /* check file extension, then play the image in an appropriate manner */
-    if(playbackCtrl_isFileRGB565(filename) == RET_OK)     ret |= playbackCtrl_playRGB565(filename);
-    if(playbackCtrl_isFileJPEG(filename) == RET_OK)       ret |= playbackCtrl_playJPEG(filename);
-    if(playbackCtrl_isFileMotionJPEG(filename) == RET_OK) ret |= playbackCtrl_playMotionJPEGStart(filename);
+    strcpy(s_currentFilename, filename);
+    ret |= playbackCtrl_playFile(filename);
   } else {
     /* reached the end of files, or just error occurred */
     LOG("dir end\n");
@@ -275,10 +300,24 @@ static RET playbackCtrl_playNext()
   return ret;
 }
 
+static RET playbackCtrl_playFile(char* filename)
+{
+  RET ret = RET_OK;
+
+  LOG("play %s\n", filename);
+  display_drawRect(0, 0, IMAGE_SIZE_WIDTH, IMAGE_SIZE_HEIGHT, DISPLAY_COLOR_BLACK);  // background
+  /* check file extension, then play the image in an appropriate manner */
+  if(playbackCtrl_isFileRGB565(filename) == RET_OK)     ret |= playbackCtrl_playRGB565(filename);
+  if(playbackCtrl_isFileJPEG(filename) == RET_OK)       ret |= playbackCtrl_playJPEG(filename);
+  if(playbackCtrl_isFileMotionJPEG(filename) == RET_OK) ret |= playbackCtrl_playMotionJPEGStart(filename);
+
+  return ret;
+}
+
 static RET playbackCtrl_isFileRGB565(char *filename)
 {
   /* check if the extension is rgb */
-  for(uint32_t i = 0; (i < 16) && (filename[i] != '\0'); i++) {
+  for(uint32_t i = 0; (i < FILENAME_PATH_SIZE) && (filename[i] != '\0'); i++) {
     if( (filename[i] == '.') && (filename[i+1] == 'R') && (filename[i+2] == 'G') && (filename[i+3] == 'B') )
       return RET_OK;
   }
@@ -288,7 +327,7 @@ static RET playbackCtrl_isFileRGB565(char *filename)
 static RET playbackCtrl_isFileJPEG(char *filename)
 {
   /* check if the extension is jpg */
-  for(uint32_t i = 0; (i < 16) && (filename[i] != '\0'); i++) {
+  for(uint32_t i = 0; (i < FILENAME_PATH_SIZE) && (filename[i] != '\0'); i++) {
     if( (filename[i] == '.') && (filename[i+1] == 'J') && (filename[i+2] == 'P') )
       return RET_OK;
   }
@@ -299,7 +338,7 @@ static RET playbackCtrl_isFileMotionJPEG(char *filename)
 {
   uint8_t isAvi = 0;
   /* check if the extension is avi */
-  for(uint32_t i = 0; (i < 16) && (filename[i] != '\0'); i++) {
+  for(uint32_t i = 0; (i < FILENAME_PATH_SIZE) && (filename[i] != '\0'); i++) {
     if( (filename[i] == '.') && (filename[i+1] == 'A') && (filename[i+2] == 'V') ) {
       isAvi = 1;
     }
@@ -307,7 +346,10 @@ static RET playbackCtrl_isFileMotionJPEG(char *filename)
 
   if(!isAvi) return RET_NO_DATA;
 
-  if( (filename[0] == FILENAME_MOVIE[0]) && (filename[1] == FILENAME_MOVIE[1]) && (filename[2] == FILENAME_MOVIE[2]) ) {
+  /* check the prefix of the name in the folder */
+  char *p_name = strrchr(filename, '/');
+  p_name = (p_name != 0) ? p_name + 1 : filename;
+  if( (p_name[0] == FILENAME_MOVIE[0]) && (p_name[1] == FILENAME_MOVIE[1]) && (p_name[2] == FILENAME_MOVIE[2]) ) {
     // motion jpeg file recorded by this device
     s_currentTargetFPS = MOTION_JPEG_FPS_MSEC;
   } else {
@@ -353,8 +395,8 @@ static RET playbackCtrl_playJPEG(char* filename)
 {
   RET ret = RET_OK;
   FIL* p_fil;
-
-  ret |= display_setArea(0, 0, IMAGE_SIZE_WIDTH - 1, IMAGE_SIZE_HEIGHT - 1);
+  uint32_t thumbOffset;
+  uint8_t isThumbnailShown = 0;
 
   ret  |= file_loadStart(filename);
   p_fil = file_loadGetCurrentFil();
@@ -364,7 +406,22 @@ static RET playbackCtrl_playJPEG(char* filename)
     return RET_ERR_FILE | ret;
   }
 
-  ret |= playbackCtrl_decodeJpeg(p_fil, IMAGE_SIZE_WIDTH, IMAGE_SIZE_HEIGHT);
+  /* show the EXIF thumbnail (enlarged to the screen) as a preview until the main image is decoded */
+  if(playbackCtrl_findThumbnail(p_fil, &thumbOffset) == RET_OK) {
+    ret |= f_lseek(p_fil, thumbOffset);
+    jpegFile_resetSrc();
+    if( (ret == RET_OK) && (playbackCtrl_decodeJpeg(p_fil, IMAGE_SIZE_WIDTH, IMAGE_SIZE_HEIGHT, 1, 0, 0) == RET_OK) ) {
+      isThumbnailShown = 1;
+    }
+  }
+
+  /* the thumbnail is enough while browsing */
+  if(!s_isBrowsing || !isThumbnailShown) {
+    ret |= f_lseek(p_fil, 0);
+    jpegFile_resetSrc();
+    ret |= display_setArea(0, 0, IMAGE_SIZE_WIDTH - 1, IMAGE_SIZE_HEIGHT - 1);
+    ret |= playbackCtrl_decodeJpeg(p_fil, IMAGE_SIZE_WIDTH, IMAGE_SIZE_HEIGHT, 0, 0, 0);
+  }
   ret |= file_loadStop();
 
   if(ret != RET_OK)LOG_E("%08X\n", ret);
@@ -389,6 +446,15 @@ static RET playbackCtrl_playMotionJPEGStart(char* filename)
     return RET_ERR;
   }
 
+  uint32_t frameMSec = 0;
+  if(avi_readStart(sp_movieFil, &frameMSec) == RET_OK) {
+    s_isMovieAvi = 1;
+    if(frameMSec > 0) s_currentTargetFPS = frameMSec;
+  } else {
+    s_isMovieAvi = 0;
+  }
+  jpegFile_resetSrc();
+
   s_status = MOVIE_PLAYING;
   s_lastFrameStartTimeMSec = HAL_GetTick();
 
@@ -400,6 +466,7 @@ static RET playbackCtrl_playMotionJPEGStart(char* filename)
 static RET playbackCtrl_playMotionJPEGStop()
 {
   RET ret = RET_OK;
+  if(s_isMovieAvi) ret |= avi_readFinish();
   ret |= file_loadStop();
 
   display_osdMark(DISPLAY_OSD_TYPE_STOP);
@@ -414,48 +481,29 @@ static RET playbackCtrl_playMotionJPEGStop()
 static RET playbackCtrl_playMotionJPEGNext()
 {
   RET ret;
-  ret = playbackCtrl_decodeJpeg(sp_movieFil, IMAGE_SIZE_WIDTH, IMAGE_SIZE_HEIGHT);
+  uint32_t frameSize;
+
+  if(s_isMovieAvi) {
+    /* jump to the next frame directly */
+    ret = avi_readFrameNext(&frameSize);
+    if(ret != RET_OK) {
+      /* end of file */
+      playbackCtrl_playMotionJPEGStop();
+      return (ret == RET_NO_DATA) ? RET_OK : ret;
+    }
+    jpegFile_resetSrc();  // file pointer has been moved
+    s_movieFrameOffset = f_tell(sp_movieFil);
+  }
+
+  ret = playbackCtrl_decodeJpeg(sp_movieFil, IMAGE_SIZE_WIDTH, IMAGE_SIZE_HEIGHT, 0, 0, 0);
   if(ret != RET_OK) {
     LOG_E("%d\n", ret);
     playbackCtrl_playMotionJPEGStop();
     return ret;
   }
 
-  /* prepare FIL object for the next frame JPEG (in the same file) */
-  /* move FIL pointer back to the end of last EOI(0xFF 0xD9) because libjpeg might has read too many*/
-  /* the border between JPEG(n-1) and JPEG(n) is 0xFF 0xD9 0xFF 0xD8 0xFF 0xE0 */
-  uint8_t buff[3] = {0};
-  uint32_t num;
-  if(f_tell(sp_movieFil) > INPUT_BUF_SIZE){
-    /* 1. move back by 512 byte */
-    f_lseek(sp_movieFil, f_tell(sp_movieFil) - INPUT_BUF_SIZE);
-    /* 2. then, search for EOI */
-    while(1) {
-      ret = file_load(buff, 2, &num);
-      if( (ret == RET_OK) && (num == 2) ) {
-        if( (buff[0] == 0xFF) && (buff[1] == 0xD9) ){
-          break;
-        } else if( (buff[2] == 0xFF) && (buff[0] == 0xD9) ){
-          /* for odd address */
-          f_lseek(sp_movieFil, f_tell(sp_movieFil) - 1);
-          break;
-        } else {
-          buff[2] = buff[1];
-          continue;
-        }
-      } else {
-        /* end of file */
-        playbackCtrl_playMotionJPEGStop();
-        break;
-      }
-    }
-  } else {
-    /* something is wrong (or too small file?) */
-    LOG_E("%d\n", f_tell(sp_movieFil));
-    playbackCtrl_playMotionJPEGStop();
-  }
-
-  if( f_tell(sp_movieFil) == f_size(sp_movieFil) ){
+  /* the source manager stops exactly at EOI, so the next frame continues from there without rewinding */
+  if( !s_isMovieAvi && jpegFile_isSrcEnd(sp_movieFil) ) {
     /* end of file */
     playbackCtrl_playMotionJPEGStop();
   }
@@ -463,16 +511,51 @@ static RET playbackCtrl_playMotionJPEGNext()
   return RET_OK;
 }
 
+/* draw the rows under the pause mark from the current frame again. the next frame is still read by AVI index */
+static RET playbackCtrl_erasePauseMark()
+{
+  RET ret = RET_OK;
+  uint32_t yStart, yEnd;
 
-static RET playbackCtrl_decodeJpeg(FIL *p_file, uint32_t maxWidth, uint32_t maxHeight)
+  if(!s_isMovieAvi) return RET_DO_NOTHING;  // the position of the frame is not known
+  display_osdGetRows(DISPLAY_OSD_TYPE_PAUSE, &yStart, &yEnd);
+  ret |= f_lseek(sp_movieFil, s_movieFrameOffset);
+  jpegFile_resetSrc();
+  if(ret == RET_OK) ret |= playbackCtrl_decodeJpeg(sp_movieFil, IMAGE_SIZE_WIDTH, IMAGE_SIZE_HEIGHT, 0, yStart, yEnd);
+  if(ret != RET_OK) LOG_E("%08X\n", ret);
+  return ret;
+}
+
+/* read the top of the file, and get the position of the EXIF thumbnail */
+static RET playbackCtrl_findThumbnail(FIL *p_file, uint32_t *p_offset)
+{
+  RET ret;
+  UINT num;
+  uint32_t size;
+
+  uint8_t *p_head = pvPortMalloc(EXIF_HEAD_SIZE);
+  if(p_head == 0) return RET_ERR_MEMORY;
+  ret = f_read(p_file, p_head, EXIF_HEAD_SIZE, &num);
+  if(ret == RET_OK) ret = exif_findThumbnail(p_head, num, p_offset, &size);
+  vPortFree(p_head);
+
+  return ret;
+}
+
+/* isFit = 1: a small image (e.g. thumbnail) is enlarged to fit the area by repeating pixels */
+/* yEnd > 0: only rows [yStart, yEnd) of an image of max size are drawn. decode starts from the restart marker above yStart (if any) */
+static RET playbackCtrl_decodeJpeg(FIL *p_file, uint32_t maxWidth, uint32_t maxHeight, uint8_t isFit, uint32_t yStart, uint32_t yEnd)
 {
   int ret = 0;
+  uint32_t zoom = 1;
+  uint32_t row = 0;   // row of the image being decoded
+  uint8_t isBandEnd = 0;
 
   uint32_t start = HAL_GetTick();
 
   /*** alloc memory ***/
   struct jpeg_decompress_struct* p_cinfo = pvPortMalloc(sizeof(struct jpeg_decompress_struct));
-  struct jpeg_error_mgr* p_jerr          = pvPortMalloc(sizeof(struct jpeg_error_mgr));
+  PLAYBACK_JPEG_ERR* p_jerr              = pvPortMalloc(sizeof(PLAYBACK_JPEG_ERR));
   uint8_t* p_lineBuffRGB888              = pvPortMalloc(IMAGE_SIZE_WIDTH*3);
   JSAMPROW buffer[2] = {0};
 
@@ -486,10 +569,21 @@ static RET playbackCtrl_decodeJpeg(FIL *p_file, uint32_t maxWidth, uint32_t maxH
 
   /*** prepare libjpeg ***/
   buffer[0] = p_lineBuffRGB888;
-  p_cinfo->err = jpeg_std_error(p_jerr);
+  p_cinfo->err = jpeg_std_error(&p_jerr->pub);
   p_cinfo->err->output_message = playbackCtrl_libjpeg_output_message;  // over-write error output function
+  p_cinfo->err->error_exit = playbackCtrl_libjpeg_error_exit;
+  if(setjmp(p_jerr->jmpBuf)) {
+    /* libjpeg stopped by error (e.g. broken data) */
+    LOG_E("Decode Abort\n");
+    jpeg_destroy_decompress(p_cinfo);
+    vPortFree(p_cinfo);
+    vPortFree(p_jerr);
+    vPortFree(p_lineBuffRGB888);
+    jpegFile_resetSrc();
+    return RET_ERR;
+  }
   jpeg_create_decompress(p_cinfo);
-  jpeg_stdio_src(p_cinfo, p_file);
+  jpegFile_setSrc(p_cinfo, p_file);
 
   /* get jpeg info to resize appropriate size */
   ret = jpeg_read_header(p_cinfo, TRUE);
@@ -503,7 +597,7 @@ static RET playbackCtrl_decodeJpeg(FIL *p_file, uint32_t maxWidth, uint32_t maxH
   }
 
   /* calculate output size */
-  ret = playbackCtrl_calcJpegOutputSize(p_cinfo, maxWidth, maxHeight);
+  ret = playbackCtrl_calcJpegOutputSize(p_cinfo, maxWidth, maxHeight, isFit ? &zoom : 0);
   if(ret != RET_OK) {
     LOG_E("unsupported size %d %d\n", p_cinfo->image_width, p_cinfo->image_height);
     jpeg_destroy_decompress(p_cinfo);
@@ -513,6 +607,24 @@ static RET playbackCtrl_decodeJpeg(FIL *p_file, uint32_t maxWidth, uint32_t maxH
     return RET_ERR;
   }
 
+  /* skip restart intervals above the band */
+  if( (yEnd > 0) && (p_cinfo->image_width == maxWidth) && (p_cinfo->image_height == maxHeight) ) {
+    ret = display_setArea(0, yStart, maxWidth - 1, yEnd - 1);
+    if(ret == RET_OK) ret = jpegFile_skipRows(p_cinfo, yStart, &row);
+    if(ret != RET_OK) {
+      LOG_E("%d\n", ret);
+      jpeg_destroy_decompress(p_cinfo);
+      vPortFree(p_cinfo);
+      vPortFree(p_jerr);
+      vPortFree(p_lineBuffRGB888);
+      jpegFile_resetSrc();
+      return RET_ERR;
+    }
+  } else {
+    yStart = 0;
+    yEnd = 0;
+  }
+
   /* jpeg decode setting */
   p_cinfo->dct_method = JDCT_IFAST;
 //  p_cinfo->dither_mode = JDITHER_ORDERED;
@@ -529,16 +641,29 @@ static RET playbackCtrl_decodeJpeg(FIL *p_file, uint32_t maxWidth, uint32_t maxH
 
   /*** decode jpeg and display it line by line ***/
   while( p_cinfo->output_scanline < p_cinfo->output_height ) {
+    if( (yEnd > 0) && (row >= yEnd) ) {
+      isBandEnd = 1;
+      break;
+    }
     if (jpeg_read_scanlines(p_cinfo, buffer, 1) != 1) {
       LOG_E("Decode Stop at line %d\n", p_cinfo->output_scanline);
       break;
     }
-    playbackCtrl_drawRGB888(p_lineBuffRGB888, p_cinfo->output_width);
+    if(row++ < yStart) continue;
+    for(uint32_t i = 0; i < zoom; i++) {
+      playbackCtrl_drawRGB888(p_lineBuffRGB888, p_cinfo->output_width, zoom);
+    }
   }
 
-  ret = jpeg_finish_decompress(p_cinfo);
-  if(ret != 1) {
-    LOG_E("%d\n", ret);
+  if(isBandEnd) {
+    /* the rest of the image is not read */
+    jpeg_abort_decompress(p_cinfo);
+    jpegFile_resetSrc();
+  } else {
+    ret = jpeg_finish_decompress(p_cinfo);
+    if(ret != 1) {
+      LOG_E("%d\n", ret);
+    }
   }
   jpeg_destroy_decompress(p_cinfo);
 
@@ -560,19 +685,30 @@ static void playbackCtrl_libjpeg_output_message (j_common_ptr cinfo)
   printf( "%s\n", buffer);
 }
 
-static void playbackCtrl_drawRGB888 (uint8_t* rgb888, uint32_t width)
+static void playbackCtrl_libjpeg_error_exit (j_common_ptr cinfo)
+{
+  PLAYBACK_JPEG_ERR *p_err = (PLAYBACK_JPEG_ERR *)cinfo->err;
+  (*cinfo->err->output_message) (cinfo);
+  longjmp(p_err->jmpBuf, 1);
+}
+
+static void playbackCtrl_drawRGB888 (uint8_t* rgb888, uint32_t width, uint32_t zoom)
 {
   for(uint32_t x = 0; x < width; x++) {
     uint16_t rgb565;
     rgb565 = (((*rgb888)<<8)&0xF800) | (((*(rgb888+1))<<3)&0x07E0) | (((*(rgb888+2))>>3)&0x001F);
-    display_putPixelRGB565(rgb565);
+    for(uint32_t i = 0; i < zoom; i++) {
+      display_putPixelRGB565(rgb565);
+    }
     rgb888 += 3;
   }
 }
 
-static RET playbackCtrl_calcJpegOutputSize(struct jpeg_decompress_struct* p_cinfo, uint32_t maxWidth, uint32_t maxHeight)
+/* p_zoom != 0: an image smaller than max size is enlarged by an integer factor (returned) */
+static RET playbackCtrl_calcJpegOutputSize(struct jpeg_decompress_struct* p_cinfo, uint32_t maxWidth, uint32_t maxHeight, uint32_t *p_zoom)
 {
   RET ret;
+  uint32_t zoom = 1;
   if( (p_cinfo->image_width == maxWidth) && (p_cinfo->image_height == maxHeight) ) return RET_OK;
 
   uint32_t scaleX = 8, scaleY = 8;    // real scale = scale / 8
@@ -607,8 +743,15 @@ static RET playbackCtrl_calcJpegOutputSize(struct jpeg_decompress_struct* p_cinf
 
   jpeg_calc_output_dimensions(p_cinfo);
 
-  ret = display_setArea( (maxWidth - p_cinfo->output_width) / 2, (maxHeight - p_cinfo->output_height) / 2,
-                         (maxWidth + p_cinfo->output_width) / 2 - 1, (maxHeight + p_cinfo->output_height) / 2 - 1);
+  if(p_zoom != 0) {
+    zoom = maxWidth / p_cinfo->output_width;
+    if(maxHeight / p_cinfo->output_height < zoom) zoom = maxHeight / p_cinfo->output_height;
+    if(zoom == 0) zoom = 1;
+    *p_zoom = zoom;
+  }
+
+  ret = display_setArea( (maxWidth - p_cinfo->output_width * zoom) / 2, (maxHeight - p_cinfo->output_height * zoom) / 2,
+                         (maxWidth + p_cinfo->output_width * zoom) / 2 - 1, (maxHeight + p_cinfo->output_height * zoom) / 2 - 1);
   return ret;
 }
 
@@ -24,12 +24,17 @@ static I2C_HandleTypeDef  *sp_hi2c;
 static uint32_t    s_destAddressForContiuousMode;
 static void (* s_cbHsync)(uint32_t h);
 static void (* s_cbVsync)(uint32_t v);
+static void (* s_cbStrip)(uint32_t strip);
+static uint32_t s_currentStrip;
+static volatile uint32_t s_dmaErrorNum;   // DMA errors during the current strip capture (counted in interrupt)
 static uint32_t s_currentH;
 static uint32_t s_currentV;
 
 /*** Internal Function Declarations ***/
 static RET ov7670_write(uint8_t regAddr, uint8_t data);
 static RET ov7670_read(uint8_t regAddr, uint8_t *data);
+static void ov7670_cbDmaStrip(DMA_HandleTypeDef *hdma);
+static void ov7670_cbDmaError(DMA_HandleTypeDef *hdma);
 
 /*** External Function Defines ***/
 RET ov7670_init(DCMI_HandleTypeDef *p_hdcmi, DMA_HandleTypeDef *p_hdma_dcmi, I2C_HandleTypeDef *p_hi2c)
@@ -64,12 +69,27 @@ RET ov7670_config(uint32_t mode)
     ov7670_write(OV7670_reg[i][0], OV7670_reg[i][1]);
     HAL_Delay(1);
   }
+  if(mode == OV7670_MODE_QVGA_YUV) {
+    for(int i = 0; OV7670_regYUV[i][0] != REG_BATT; i++) {
+      ov7670_write(OV7670_regYUV[i][0], OV7670_regYUV[i][1]);
+      HAL_Delay(1);
+    }
+  }
   return RET_OK;
 }
 
+/* divide pclk (and frame rate) by div (1 - 64) */
+RET ov7670_setClockDivider(uint32_t div)
+{
+  if( (div < 1) || (div > 64) ) return RET_ERR_PARAM;
+  return ov7670_write(0x11, (uint8_t)(div - 1));  // CLKRC pre-scalar
+}
+
 RET ov7670_startCap(uint32_t capMode, uint32_t destAddress)
 {
   ov7670_stopCap();
+  /* destAddress is the data register of display. DMA must not increment it */
+  sp_hdma_dcmi->Instance->CR &= ~DMA_SxCR_MINC;
   if (capMode == OV7670_CAP_CONTINUOUS) {
     /* note: continuous mode automatically invokes DCMI, but DMA needs to be invoked manually */
     s_destAddressForContiuousMode = destAddress;
@@ -82,6 +102,46 @@ RET ov7670_startCap(uint32_t capMode, uint32_t destAddress)
   return RET_OK;
 }
 
+/*
+ * capture one frame into 2 memory buffers alternately (DMA double buffer mode)
+ * cbStrip(strip) is called from interrupt when each strip (stripSize bytes) is filled. strip N is stored in buffer (N % 2)
+ * the caller must finish using a buffer before the next strip is filled, otherwise it is over-written
+ */
+RET ov7670_startCapStrip(uint32_t destAddress0, uint32_t destAddress1, uint32_t stripSize, void (*cbStrip)(uint32_t strip))
+{
+  ov7670_stopCap();
+  s_destAddressForContiuousMode = 0;
+  s_cbStrip = cbStrip;
+  s_currentStrip = 0;
+  s_dmaErrorNum = 0;
+
+  /* the stream is disabled by ov7670_stopCap, so configuration can be changed */
+  sp_hdma_dcmi->Instance->CR |= DMA_SxCR_MINC;
+  sp_hdma_dcmi->XferCpltCallback   = ov7670_cbDmaStrip;
+  sp_hdma_dcmi->XferM1CpltCallback = ov7670_cbDmaStrip;
+  sp_hdma_dcmi->XferErrorCallback  = ov7670_cbDmaError;
+  sp_hdma_dcmi->XferAbortCallback  = 0;
+
+  /* same as HAL_DCMI_Start_DMA, but with my own buffers */
+  sp_hdcmi->State = HAL_DCMI_STATE_BUSY;
+  __HAL_DCMI_ENABLE(sp_hdcmi);
+  sp_hdcmi->Instance->CR &= ~(DCMI_CR_CM);
+  sp_hdcmi->Instance->CR |= DCMI_MODE_SNAPSHOT;
+  if(HAL_DMAEx_MultiBufferStart_IT(sp_hdma_dcmi, (uint32_t)&sp_hdcmi->Instance->DR, destAddress0, destAddress1, stripSize / 4) != HAL_OK) {
+    return RET_ERR;
+  }
+  __HAL_DCMI_ENABLE_IT(sp_hdcmi, DCMI_IT_FRAME);
+  sp_hdcmi->Instance->CR |= DCMI_CR_CAPTURE;
+
+  return RET_OK;
+}
+
+/* DMA errors since ov7670_startCapStrip. read this after ov7670_stopCap (printf cannot be used in interrupt) */
+uint32_t ov7670_getDmaErrorNum()
+{
+  return s_dmaErrorNum;
+}
+
 RET ov7670_stopCap()
 {
   HAL_DCMI_Stop(sp_hdcmi);
@@ -120,6 +180,17 @@ void HAL_DCMI_VsyncEventCallback(DCMI_HandleTypeDef *hdcmi)
 //}
 
 /*** Internal Function Defines ***/
+static void ov7670_cbDmaStrip(DMA_HandleTypeDef *hdma)
+{
+  if(s_cbStrip)s_cbStrip(s_currentStrip);
+  s_currentStrip++;
+}
+
+static void ov7670_cbDmaError(DMA_HandleTypeDef *hdma)
+{
+  s_dmaErrorNum++;
+}
+
 static RET ov7670_write(uint8_t regAddr, uint8_t data)
 {
   HAL_StatusTypeDef ret;
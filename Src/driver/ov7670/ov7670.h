@@ -16,8 +16,11 @@
 
 RET ov7670_init(DCMI_HandleTypeDef *p_hdcmi, DMA_HandleTypeDef *p_hdma_dcmi, I2C_HandleTypeDef *p_hi2c);
 RET ov7670_config(uint32_t mode);
+RET ov7670_setClockDivider(uint32_t div);
 RET ov7670_startCap(uint32_t capMode, uint32_t destAddress);
+RET ov7670_startCapStrip(uint32_t destAddress0, uint32_t destAddress1, uint32_t stripSize, void (*cbStrip)(uint32_t strip));
 RET ov7670_stopCap();
+uint32_t ov7670_getDmaErrorNum();
 void ov7670_registerCallback(void (*cbHsync)(uint32_t h), void (*cbVsync)(uint32_t v));
 
 #endif /* OV7670_OV7670_H_ */
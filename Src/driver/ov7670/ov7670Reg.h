@@ -114,5 +114,13 @@ const uint8_t OV7670_reg[][2] = {
   {REG_BATT, REG_BATT},
 };
 
+/* written after OV7670_reg for YUV422 output */
+/* byte order is the same as RGB565 (U Y V Y), so that Y is stored in the upper byte of each pixel of display */
+const uint8_t OV7670_regYUV[][2] = {
+  {0x12, 0x10},   // QVGA, YUV
+  {0x40, 0xc0},   // 00 - FF
+  {REG_BATT, REG_BATT},
+};
+
 
 #endif /* OV7670_OV7670REG_H_ */
@@ -61,11 +61,29 @@ RET camera_startCap(uint32_t capMode, void* destHandle)
   return ov7670_startCap(ov7670CapMode, (uint32_t)destHandle);
 }
 
+/* capture one frame into 2 buffers alternately. cbStrip is called (from interrupt) when each strip is filled */
+RET camera_startCapStrip(void* p_buff0, void* p_buff1, uint32_t stripSize, void (*cbStrip)(uint32_t strip))
+{
+  return ov7670_startCapStrip((uint32_t)p_buff0, (uint32_t)p_buff1, stripSize, cbStrip);
+}
+
+/* slow down the camera (frame rate becomes 1/div) */
+RET camera_setClockDivider(uint32_t div)
+{
+  return ov7670_setClockDivider(div);
+}
+
 RET camera_stopCap()
 {
   return ov7670_stopCap();
 }
 
+/* DMA errors during the last strip capture (camera_startCapStrip) */
+uint32_t camera_getDmaErrorNum()
+{
+  return ov7670_getDmaErrorNum();
+}
+
 void camera_registerCallback(void (*cbHsync)(uint32_t h), void (*cbVsync)(uint32_t v))
 {
   ov7670_registerCallback(cbHsync, cbVsync);
@@ -17,7 +17,10 @@
 RET camera_init();
 RET camera_config(uint32_t mode);
 RET camera_startCap(uint32_t capMode, void* destHandle);
+RET camera_startCapStrip(void* p_buff0, void* p_buff1, uint32_t stripSize, void (*cbStrip)(uint32_t strip));
+RET camera_setClockDivider(uint32_t div);
 RET camera_stopCap();
+uint32_t camera_getDmaErrorNum();
 void camera_registerCallback(void (*cbHsync)(uint32_t h), void (*cbVsync)(uint32_t v));
 
 #endif /* HAL_CAMERA_H_ */
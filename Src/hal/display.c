@@ -122,6 +122,25 @@ void display_osdMark(uint32_t osdType)
   display_setArea(s_xStart, s_yStart, s_xEnd, s_yEnd);
 }
 
+/* rows covered by the mark (yEnd is exclusive). yStart = yEnd = 0 if nothing is drawn */
+void display_osdGetRows(uint32_t osdType, uint32_t *p_yStart, uint32_t *p_yEnd)
+{
+  switch(osdType) {
+  case DISPLAY_OSD_TYPE_PAUSE:
+    *p_yStart = 35;
+    *p_yEnd   = LCD_ILI9342_HEIGHT - 35;
+    break;
+  case DISPLAY_OSD_TYPE_STOP:
+    *p_yStart = LCD_ILI9342_HEIGHT / 2 - 45;
+    *p_yEnd   = LCD_ILI9342_HEIGHT / 2 + 45;
+    break;
+  default:
+    *p_yStart = 0;
+    *p_yEnd   = 0;
+    break;
+  }
+}
+
 void display_osdBar(uint32_t level)
 {
   const uint32_t MARGINE = 20;
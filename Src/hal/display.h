@@ -31,5 +31,6 @@ void display_writeImage(void* canvasHandle, uint32_t pixelNum);
 void display_putPixelRGB565(uint16_t rgb565);
 void display_readImageRGB888(uint8_t *p_buff, uint32_t width);
 void display_osdMark(uint32_t osdType);
+void display_osdGetRows(uint32_t osdType, uint32_t *p_yStart, uint32_t *p_yEnd);
 
 #endif /* HAL_DISPLAY_H_ */
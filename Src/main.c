@@ -55,6 +55,7 @@
 /* USER CODE BEGIN Includes */
 #include "common.h"
 #include "commonMsg.h"
+#include "applicationSettings.h"
 
 /* USER CODE END Includes */
 
@@ -65,6 +66,8 @@ DMA_HandleTypeDef hdma_dcmi;
 I2C_HandleTypeDef hi2c2;
 
 SPI_HandleTypeDef hspi1;
+DMA_HandleTypeDef hdma_spi1_rx;
+DMA_HandleTypeDef hdma_spi1_tx;
 
 TIM_HandleTypeDef htim5;
 
@@ -86,6 +89,8 @@ osMessageQId QueueInputHandle;
 /* USER CODE BEGIN PV */
 /* Private variables ---------------------------------------------------------*/
 osPoolId  MpoolMessageHandle;
+osThreadId FileWriterHandle;
+osMessageQId QueueFileWriterHandle;
 
 /* USER CODE END PV */
 
@@ -107,6 +112,7 @@ extern void input_task(void const * argument);
 
 /* USER CODE BEGIN PFP */
 /* Private function prototypes -----------------------------------------------*/
+extern void fileWriter_task(void const * argument);
 
 /* USER CODE END PFP */
 
@@ -122,6 +128,8 @@ osMessageQId getQueueId(MODULE_ID moduleId)
     return QueuePlaybackCtrlHandle;
   case INPUT:
     return QueueInputHandle;
+  case FILE_WRITER:
+    return QueueFileWriterHandle;
   default:
     return 0;
   }
@@ -216,6 +224,9 @@ int main(void)
   InputHandle = osThreadCreate(osThread(Input), NULL);
 
   /* USER CODE BEGIN RTOS_THREADS */
+  /* writes movie data while LiveviewCtrl encodes the next frame. higher priority so that SD card is kept busy */
+  osThreadDef(FileWriter, fileWriter_task, osPriorityAboveNormal, 0, 512);
+  FileWriterHandle = osThreadCreate(osThread(FileWriter), NULL);
 
   /* USER CODE END RTOS_THREADS */
 
@@ -240,6 +251,10 @@ int main(void)
   /* create memory pool for message b/w modules */
   osPoolDef(MpoolMessage, 16, MSG_STRUCT);
   MpoolMessageHandle = osPoolCreate(osPool(MpoolMessage));
+
+  /* jobs for FileWriter (each job owns a buffer, so the queue never overflows) */
+  osMessageQDef(QueueFileWriter, MOVIE_WRITER_BUFF_NUM, uint32_t);
+  QueueFileWriterHandle = osMessageCreate(osMessageQ(QueueFileWriter), NULL);
   /* USER CODE END RTOS_QUEUES */
  
 
@@ -446,9 +461,15 @@ static void MX_DMA_Init(void)
   /* DMA1_Stream5_IRQn interrupt configuration */
   HAL_NVIC_SetPriority(DMA1_Stream5_IRQn, 5, 0);
   HAL_NVIC_EnableIRQ(DMA1_Stream5_IRQn);
+  /* DMA2_Stream0_IRQn interrupt configuration */
+  HAL_NVIC_SetPriority(DMA2_Stream0_IRQn, 5, 0);
+  HAL_NVIC_EnableIRQ(DMA2_Stream0_IRQn);
   /* DMA2_Stream1_IRQn interrupt configuration */
   HAL_NVIC_SetPriority(DMA2_Stream1_IRQn, 5, 0);
   HAL_NVIC_EnableIRQ(DMA2_Stream1_IRQn);
+  /* DMA2_Stream3_IRQn interrupt configuration */
+  HAL_NVIC_SetPriority(DMA2_Stream3_IRQn, 5, 0);
+  HAL_NVIC_EnableIRQ(DMA2_Stream3_IRQn);
 
 }
 
@@ -0,0 +1,494 @@
+/*
+ * avi.c
+ *
+ *  Created on: 2017/09/10
+ *      Author: take-iwiw
+ */
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include "cmsis_os.h"
+#include "common.h"
+#include "ff.h"
+#include "fileWriter.h"
+#include "avi.h"
+
+/*** Internal Const Values, Macros ***/
+#define LOG(str, ...) printf("[AVI:%d] " str, __LINE__, ##__VA_ARGS__);
+#define LOG_E(str, ...) printf("[AVI_ERR:%d] " str, __LINE__, ##__VA_ARGS__);
+
+#define AVI_INDEX_FILENAME  "AVIIDX.TMP"  // idx1 entries are stored here during recording, then appended to the movie file
+#define AVI_INDEX_BUFF_NUM  32            // number of idx1 entries kept in RAM before flushing them to AVI_INDEX_FILENAME
+#define AVI_INDEX_ENTRY_SIZE 16
+#define AVI_FLAG_KEYFRAME   0x00000010
+#define AVI_FLAG_HASINDEX   0x00000010
+
+/* header layout (offset from the top of file) */
+#define AVI_HEADER_SIZE           224
+#define AVI_POS_RIFF_SIZE         4
+#define AVI_POS_AVIH_USEC         32
+#define AVI_POS_AVIH_MAXBYTES     36
+#define AVI_POS_AVIH_FRAMES       48
+#define AVI_POS_AVIH_BUFFSIZE     60
+#define AVI_POS_STRH_SCALE        128
+#define AVI_POS_STRH_LENGTH       140
+#define AVI_POS_STRH_BUFFSIZE     144
+#define AVI_POS_MOVI_SIZE         216
+#define AVI_POS_MOVI_FOURCC       220
+
+/*** Internal Static Variables ***/
+static FIL      *sp_fil;
+static FIL      s_filIndex;
+static uint32_t s_frameNum;
+static uint32_t s_frameStartPos;   // position of '00dc' of the current frame
+static uint32_t s_maxFrameSize;
+static uint32_t s_startTimeMSec;
+static uint8_t  s_isFixedRate;      // 1: frame rate in header is not changed by the actual recording time (e.g. time-lapse)
+static uint8_t  s_indexBuff[AVI_INDEX_BUFF_NUM * AVI_INDEX_ENTRY_SIZE];
+static uint32_t s_indexBuffNum;
+
+/* for read */
+static FIL      *sp_filRead;
+static uint8_t  s_isReadIndexed;    // 1: frames are located by idx1, 0: by walking 'movi' chunks (e.g. idx1 was not written)
+static uint32_t s_readPos;          // next idx1 entry to be cached, or the next chunk in 'movi'
+static uint32_t s_readEnd;
+static uint32_t s_readOffsetBase;   // idx1 offset is relative to 'movi' (usually) or to the top of file
+static uint8_t  s_readIndexBuff[AVI_INDEX_BUFF_NUM * AVI_INDEX_ENTRY_SIZE];
+static uint32_t s_readIndexBuffNum;
+static uint32_t s_readIndexBuffCur;
+
+/*** Internal Function Declarations ***/
+static void avi_setU32(uint8_t *p_buff, uint32_t val);
+static void avi_setFourcc(uint8_t *p_buff, const char *fourcc);
+static RET avi_patchU32(uint32_t pos, uint32_t val);
+static RET avi_flushIndex();
+static uint32_t avi_getU32(const uint8_t *p_buff);
+static uint8_t avi_isVideoChunk(const uint8_t *p_fourcc);
+static uint8_t avi_isChunkId(const uint8_t *p_fourcc);
+static RET avi_readChunkHeader(uint32_t pos, uint8_t *p_buff, uint32_t size);
+static RET avi_fillReadIndex();
+
+/*** External Function Defines ***/
+/* isFixedRate = 0: frameMSec is replaced by the actual average at finish, 1: frameMSec is kept (e.g. playback rate of time-lapse) */
+RET avi_writeStart(FIL *p_fil, uint32_t width, uint32_t height, uint32_t frameMSec, uint8_t isFixedRate)
+{
+  FRESULT ret;
+  uint32_t num;
+  uint8_t header[AVI_HEADER_SIZE] = {0};
+
+  sp_fil = p_fil;
+  s_frameNum = 0;
+  s_maxFrameSize = 0;
+  s_indexBuffNum = 0;
+  s_startTimeMSec = HAL_GetTick();
+  s_isFixedRate = isFixedRate;
+
+  /* RIFF 'AVI ' */
+  avi_setFourcc(&header[0], "RIFF");
+  avi_setU32(&header[4], 0);                        // patched at finish
+  avi_setFourcc(&header[8], "AVI ");
+  /* LIST 'hdrl' */
+  avi_setFourcc(&header[12], "LIST");
+  avi_setU32(&header[16], 192);
+  avi_setFourcc(&header[20], "hdrl");
+  /* 'avih' (MainAVIHeader) */
+  avi_setFourcc(&header[24], "avih");
+  avi_setU32(&header[28], 56);
+  avi_setU32(&header[32], frameMSec * 1000);        // dwMicroSecPerFrame (patched at finish by the actual value)
+  avi_setU32(&header[36], 0);                       // dwMaxBytesPerSec (patched at finish)
+  avi_setU32(&header[44], AVI_FLAG_HASINDEX);       // dwFlags
+  avi_setU32(&header[48], 0);                       // dwTotalFrames (patched at finish)
+  avi_setU32(&header[56], 1);                       // dwStreams
+  avi_setU32(&header[60], 0);                       // dwSuggestedBufferSize (patched at finish)
+  avi_setU32(&header[64], width);
+  avi_setU32(&header[68], height);
+  /* LIST 'strl' */
+  avi_setFourcc(&header[88], "LIST");
+  avi_setU32(&header[92], 116);
+  avi_setFourcc(&header[96], "strl");
+  /* 'strh' (AVIStreamHeader) */
+  avi_setFourcc(&header[100], "strh");
+  avi_setU32(&header[104], 56);
+  avi_setFourcc(&header[108], "vids");
+  avi_setFourcc(&header[112], "MJPG");
+  avi_setU32(&header[128], frameMSec * 1000);       // dwScale (patched at finish by the actual value)
+  avi_setU32(&header[132], 1000000);                // dwRate
+  avi_setU32(&header[140], 0);                      // dwLength (patched at finish)
+  avi_setU32(&header[144], 0);                      // dwSuggestedBufferSize (patched at finish)
+  avi_setU32(&header[148], 0xFFFFFFFF);             // dwQuality
+  header[160] = width & 0xFF;  header[161] = width >> 8;  // rcFrame.right
+  header[162] = height & 0xFF; header[163] = height >> 8; // rcFrame.bottom
+  /* 'strf' (BITMAPINFOHEADER) */
+  avi_setFourcc(&header[164], "strf");
+  avi_setU32(&header[168], 40);
+  avi_setU32(&header[172], 40);
+  avi_setU32(&header[176], width);
+  avi_setU32(&header[180], height);
+  header[184] = 1;                                  // biPlanes
+  header[186] = 24;                                 // biBitCount
+  avi_setFourcc(&header[188], "MJPG");
+  avi_setU32(&header[192], width * height * 3);
+  /* LIST 'movi' */
+  avi_setFourcc(&header[212], "LIST");
+  avi_setU32(&header[AVI_POS_MOVI_SIZE], 4);        // patched at finish
+  avi_setFourcc(&header[AVI_POS_MOVI_FOURCC], "movi");
+
+  ret = f_write(sp_fil, header, AVI_HEADER_SIZE, (UINT*)&num);
+  if(ret != FR_OK || num != AVI_HEADER_SIZE) {
+    LOG_E("%d\n", ret);
+    return RET_ERR_FILE;
+  }
+
+  ret = f_open(&s_filIndex, AVI_INDEX_FILENAME, FA_READ | FA_WRITE | FA_CREATE_ALWAYS);
+  if(ret != FR_OK) {
+    LOG_E("%d\n", ret);
+    return RET_ERR_FILE;
+  }
+  f_chmod(AVI_INDEX_FILENAME, AM_HID | AM_SYS, AM_HID | AM_SYS);  // hide from playback
+
+  /* frames are written by FileWriter task, so that the encoder does not wait for SD card */
+  if(fileWriter_start(sp_fil) != RET_OK) {
+    f_close(&s_filIndex);
+    f_unlink(AVI_INDEX_FILENAME);
+    return RET_ERR_MEMORY;
+  }
+
+  return RET_OK;
+}
+
+/* time (HAL_GetTick) when recording started, used for the frame rate at finish. move it back if frames recorded before avi_writeStart are added */
+void avi_writeSetStartTime(uint32_t msec)
+{
+  s_startTimeMSec = msec;
+}
+
+/* frame data must be written through fileWriter between avi_writeFrameStart and avi_writeFrameFinish */
+RET avi_writeFrameStart()
+{
+  uint8_t chunkHeader[8];
+
+  s_frameStartPos = fileWriter_tell();
+  avi_setFourcc(&chunkHeader[0], "00dc");
+  avi_setU32(&chunkHeader[4], 0);   // patched at avi_writeFrameFinish
+  return fileWriter_writeData(0, chunkHeader, 8);
+}
+
+RET avi_writeFrameFinish()
+{
+  RET ret = RET_OK;
+  uint8_t buff[4];
+  uint32_t frameSize = fileWriter_tell() - s_frameStartPos - 8;
+
+  /* chunks must be word aligned */
+  if(frameSize % 2) {
+    uint8_t pad = 0;
+    ret |= fileWriter_writeData(0, &pad, 1);
+  }
+
+  /* the frame size is unknown until encoding is done */
+  avi_setU32(buff, frameSize);
+  ret |= fileWriter_patch(s_frameStartPos + 4, buff, 4);
+  if(ret != RET_OK) return ret;
+
+  /* keep idx1 entry */
+  uint8_t *p_entry = &s_indexBuff[s_indexBuffNum * AVI_INDEX_ENTRY_SIZE];
+  avi_setFourcc(&p_entry[0], "00dc");
+  avi_setU32(&p_entry[4], AVI_FLAG_KEYFRAME);
+  avi_setU32(&p_entry[8], s_frameStartPos - AVI_POS_MOVI_FOURCC); // offset from 'movi'
+  avi_setU32(&p_entry[12], frameSize);
+  s_indexBuffNum++;
+  if(s_indexBuffNum == AVI_INDEX_BUFF_NUM) {
+    ret |= avi_flushIndex();
+  }
+
+  s_frameNum++;
+  if(frameSize > s_maxFrameSize) s_maxFrameSize = frameSize;
+
+  return ret;
+}
+
+/*
+ * make the file playable as it is (e.g. in case of power loss during a long recording)
+ * sizes in the header are updated and data are flushed to the card. idx1 is not written, so players walk 'movi'
+ * call this between frames
+ */
+RET avi_writeSync()
+{
+  RET ret = RET_OK;
+  uint8_t buff[4];
+  uint32_t moviEndPos = fileWriter_tell();
+
+  ret |= avi_flushIndex();
+  avi_setU32(buff, moviEndPos - 8);
+  ret |= fileWriter_patch(AVI_POS_RIFF_SIZE, buff, 4);
+  avi_setU32(buff, moviEndPos - AVI_POS_MOVI_FOURCC);
+  ret |= fileWriter_patch(AVI_POS_MOVI_SIZE, buff, 4);
+  avi_setU32(buff, s_frameNum);
+  ret |= fileWriter_patch(AVI_POS_AVIH_FRAMES, buff, 4);
+  ret |= fileWriter_patch(AVI_POS_STRH_LENGTH, buff, 4);
+  ret |= fileWriter_flush();
+
+  return ret;
+}
+
+RET avi_writeFinish()
+{
+  RET ret = RET_OK;
+  FRESULT fret;
+  uint32_t num;
+  uint8_t buff[8];
+
+  ret |= avi_flushIndex();
+  ret |= fileWriter_finish();   // the file is accessed directly from here
+  uint32_t moviEndPos = f_tell(sp_fil);
+  uint32_t indexSize  = f_size(&s_filIndex);
+
+  /* append idx1 which has been stored in the temporary file */
+  avi_setFourcc(&buff[0], "idx1");
+  avi_setU32(&buff[4], indexSize);
+  fret = f_write(sp_fil, buff, 8, (UINT*)&num);
+  fret |= f_lseek(&s_filIndex, 0);
+  for(uint32_t copied = 0; (fret == FR_OK) && (copied < indexSize); copied += num) {
+    fret |= f_read(&s_filIndex, s_indexBuff, sizeof(s_indexBuff), (UINT*)&num);
+    fret |= f_write(sp_fil, s_indexBuff, num, (UINT*)&num);
+    if(num == 0) break;
+  }
+  fret |= f_close(&s_filIndex);
+  fret |= f_unlink(AVI_INDEX_FILENAME);
+  if(fret != FR_OK) {
+    LOG_E("%d\n", fret);
+    ret |= RET_ERR_FILE;
+  }
+
+  /* patch header by the actual values */
+  uint32_t fileSize = f_tell(sp_fil);
+  uint32_t elapsedMSec = HAL_GetTick() - s_startTimeMSec;
+  uint32_t usecPerFrame = (s_frameNum > 0) ? (uint32_t)(((uint64_t)elapsedMSec * 1000) / s_frameNum) : 0;
+  uint32_t bytesPerSec  = (elapsedMSec > 0) ? (uint32_t)(((uint64_t)(moviEndPos - AVI_HEADER_SIZE) * 1000) / elapsedMSec) : 0;
+  ret |= avi_patchU32(AVI_POS_RIFF_SIZE, fileSize - 8);
+  if( (usecPerFrame > 0) && !s_isFixedRate ) {
+    ret |= avi_patchU32(AVI_POS_AVIH_USEC, usecPerFrame);
+    ret |= avi_patchU32(AVI_POS_STRH_SCALE, usecPerFrame);
+  }
+  ret |= avi_patchU32(AVI_POS_AVIH_MAXBYTES, bytesPerSec);
+  ret |= avi_patchU32(AVI_POS_AVIH_FRAMES, s_frameNum);
+  ret |= avi_patchU32(AVI_POS_AVIH_BUFFSIZE, s_maxFrameSize);
+  ret |= avi_patchU32(AVI_POS_STRH_LENGTH, s_frameNum);
+  ret |= avi_patchU32(AVI_POS_STRH_BUFFSIZE, s_maxFrameSize);
+  ret |= avi_patchU32(AVI_POS_MOVI_SIZE, moviEndPos - AVI_POS_MOVI_FOURCC);
+  f_lseek(sp_fil, fileSize);
+
+  LOG("%d frames, %d usec/frame\n", s_frameNum, usecPerFrame);
+  sp_fil = 0;
+
+  return ret;
+}
+
+RET avi_readStart(FIL *p_fil, uint32_t *p_frameMSec)
+{
+  uint8_t buff[12];
+  uint32_t moviPos = 0, moviEnd = 0;
+  uint32_t indexPos = 0, indexEnd = 0;
+  uint32_t usecPerFrame = 0;
+
+  sp_filRead = p_fil;
+  s_readIndexBuffNum = 0;
+  s_readIndexBuffCur = 0;
+
+  if( (avi_readChunkHeader(0, buff, 12) != RET_OK) || (memcmp(&buff[0], "RIFF", 4) != 0) || (memcmp(&buff[8], "AVI ", 4) != 0) ) {
+    /* not an AVI file (e.g. just concatenated JPEG files) */
+    f_lseek(sp_filRead, 0);
+    sp_filRead = 0;
+    return RET_NO_DATA;
+  }
+
+  /* walk top level chunks to find avih, movi and idx1 */
+  uint32_t pos = 12;
+  while( (pos + 12 <= f_size(sp_filRead)) && ((moviPos == 0) || (indexPos == 0)) ) {
+    if(avi_readChunkHeader(pos, buff, 12) != RET_OK) break;
+    uint32_t size = avi_getU32(&buff[4]);
+    if(memcmp(&buff[0], "LIST", 4) == 0) {
+      if(memcmp(&buff[8], "hdrl", 4) == 0) {
+        /* avih is always the first chunk in hdrl */
+        if( (avi_readChunkHeader(pos + 12, buff, 12) == RET_OK) && (memcmp(&buff[0], "avih", 4) == 0) ) {
+          usecPerFrame = avi_getU32(&buff[8]);
+        }
+      } else if(memcmp(&buff[8], "movi", 4) == 0) {
+        moviPos = pos + 8;
+        if(size <= 4) {
+          /* size is not patched if recording was not finished. idx1 is not written either */
+          /* the file may be longer than the frames (e.g. preallocated area), so 'movi' is walked until a broken chunk */
+          moviEnd = f_size(sp_filRead);
+          break;
+        }
+        moviEnd = pos + 8 + size;
+      }
+    } else if(memcmp(&buff[0], "idx1", 4) == 0) {
+      indexPos = pos + 8;
+      indexEnd = pos + 8 + size;
+    } else if(memcmp(&buff[0], "JUNK", 4) != 0) {
+      break;  // not a top level chunk (e.g. old clusters after 'movi' of an unfinished recording)
+    }
+    pos += 8 + size + (size & 1);
+  }
+
+  if(moviPos == 0) {
+    LOG_E("movi not found\n");
+    sp_filRead = 0;
+    return RET_ERR;
+  }
+
+  if(indexPos != 0) {
+    s_isReadIndexed  = 1;
+    s_readPos        = indexPos;
+    s_readEnd        = indexEnd;
+    if(avi_fillReadIndex() != RET_OK) return RET_ERR_FILE;
+    /* offset of the first chunk is 4 when it's relative to 'movi' */
+    s_readOffsetBase = (s_readIndexBuffNum > 0 && avi_getU32(&s_readIndexBuff[8]) < moviPos) ? moviPos : 0;
+  } else {
+    LOG("idx1 not found\n");
+    s_isReadIndexed  = 0;
+    s_readPos        = moviPos + 4;
+    s_readEnd        = moviEnd;
+  }
+
+  *p_frameMSec = usecPerFrame / 1000;
+  return RET_OK;
+}
+
+/* move file pointer to the top of the next frame data */
+RET avi_readFrameNext(uint32_t *p_frameSize)
+{
+  uint8_t buff[8];
+
+  if(s_isReadIndexed) {
+    while(1) {
+      if(s_readIndexBuffCur == s_readIndexBuffNum) {
+        if(avi_fillReadIndex() != RET_OK) return RET_ERR_FILE;
+        if(s_readIndexBuffNum == 0) return RET_NO_DATA;
+      }
+      uint8_t *p_entry = &s_readIndexBuff[s_readIndexBuffCur * AVI_INDEX_ENTRY_SIZE];
+      s_readIndexBuffCur++;
+      uint32_t size = avi_getU32(&p_entry[12]);
+      if( !avi_isVideoChunk(p_entry) || (size == 0) ) continue;
+      *p_frameSize = size;
+      if(f_lseek(sp_filRead, s_readOffsetBase + avi_getU32(&p_entry[8]) + 8) != FR_OK) return RET_ERR_FILE;
+      return RET_OK;
+    }
+  } else {
+    while(s_readPos + 8 <= s_readEnd) {
+      if(avi_readChunkHeader(s_readPos, buff, 8) != RET_OK) return RET_ERR_FILE;
+      uint32_t size = avi_getU32(&buff[4]);
+      if(memcmp(&buff[0], "LIST", 4) == 0) {
+        s_readPos += 12;  // go into 'rec ' list
+        continue;
+      }
+      /* data after the last frame (e.g. old clusters in preallocated area) is not a chunk */
+      if( !avi_isChunkId(buff) || (size > s_readEnd - s_readPos - 8) ) break;
+      s_readPos += 8 + size + (size & 1);
+      if( !avi_isVideoChunk(buff) || (size == 0) ) continue;
+      *p_frameSize = size;
+      return RET_OK;  // file pointer is already at the top of the frame data
+    }
+    return RET_NO_DATA;
+  }
+}
+
+RET avi_readFinish()
+{
+  sp_filRead = 0;
+  return RET_OK;
+}
+
+/*** Internal Function Defines ***/
+static void avi_setU32(uint8_t *p_buff, uint32_t val)
+{
+  p_buff[0] = (val >>  0) & 0xFF;
+  p_buff[1] = (val >>  8) & 0xFF;
+  p_buff[2] = (val >> 16) & 0xFF;
+  p_buff[3] = (val >> 24) & 0xFF;
+}
+
+static void avi_setFourcc(uint8_t *p_buff, const char *fourcc)
+{
+  memcpy(p_buff, fourcc, 4);
+}
+
+/* over-write 4 bytes at pos, then go back to the current position */
+static RET avi_patchU32(uint32_t pos, uint32_t val)
+{
+  FRESULT ret;
+  uint32_t num;
+  uint8_t buff[4];
+  uint32_t currentPos = f_tell(sp_fil);
+
+  avi_setU32(buff, val);
+  ret = f_lseek(sp_fil, pos);
+  ret |= f_write(sp_fil, buff, 4, (UINT*)&num);
+  ret |= f_lseek(sp_fil, currentPos);
+  if(ret != FR_OK || num != 4) {
+    LOG_E("%d\n", ret);
+    return RET_ERR_FILE;
+  }
+  return RET_OK;
+}
+
+static RET avi_flushIndex()
+{
+  uint32_t size = s_indexBuffNum * AVI_INDEX_ENTRY_SIZE;
+
+  if(size == 0) return RET_OK;
+  s_indexBuffNum = 0;
+  return fileWriter_writeData(&s_filIndex, s_indexBuff, size);
+}
+
+static uint32_t avi_getU32(const uint8_t *p_buff)
+{
+  return p_buff[0] | (p_buff[1] << 8) | (p_buff[2] << 16) | ((uint32_t)p_buff[3] << 24);
+}
+
+/* ##dc (compressed video) or ##db (uncompressed video) */
+static uint8_t avi_isVideoChunk(const uint8_t *p_fourcc)
+{
+  return (p_fourcc[2] == 'd') && ( (p_fourcc[3] == 'c') || (p_fourcc[3] == 'b') );
+}
+
+/* ##xx (stream number and type. e.g. 00dc, 01wb) or JUNK */
+static uint8_t avi_isChunkId(const uint8_t *p_fourcc)
+{
+  if(memcmp(p_fourcc, "JUNK", 4) == 0) return 1;
+  return isdigit(p_fourcc[0]) && isdigit(p_fourcc[1]) && islower(p_fourcc[2]) && islower(p_fourcc[3]);
+}
+
+static RET avi_readChunkHeader(uint32_t pos, uint8_t *p_buff, uint32_t size)
+{
+  FRESULT ret;
+  uint32_t num;
+  ret = f_lseek(sp_filRead, pos);
+  ret |= f_read(sp_filRead, p_buff, size, (UINT*)&num);
+  if(ret != FR_OK || num != size) return RET_ERR_FILE;
+  return RET_OK;
+}
+
+/* cache the next idx1 entries */
+static RET avi_fillReadIndex()
+{
+  FRESULT ret;
+  uint32_t num;
+  uint32_t size = s_readEnd - s_readPos;
+
+  if(size > sizeof(s_readIndexBuff)) size = sizeof(s_readIndexBuff);
+  s_readIndexBuffNum = 0;
+  s_readIndexBuffCur = 0;
+  if(size < AVI_INDEX_ENTRY_SIZE) return RET_OK;
+
+  ret = f_lseek(sp_filRead, s_readPos);
+  ret |= f_read(sp_filRead, s_readIndexBuff, size, (UINT*)&num);
+  if(ret != FR_OK) {
+    LOG_E("%d\n", ret);
+    return RET_ERR_FILE;
+  }
+  s_readPos += num;
+  s_readIndexBuffNum = num / AVI_INDEX_ENTRY_SIZE;
+  return RET_OK;
+}
@@ -0,0 +1,21 @@
+/*
+ * avi.h
+ *
+ *  Created on: 2017/09/10
+ *      Author: take-iwiw
+ */
+
+#ifndef SERVICE_AVI_H_
+#define SERVICE_AVI_H_
+
+RET avi_writeStart(FIL *p_fil, uint32_t width, uint32_t height, uint32_t frameMSec, uint8_t isFixedRate);
+void avi_writeSetStartTime(uint32_t msec);
+RET avi_writeFrameStart();
+RET avi_writeFrameFinish();
+RET avi_writeSync();
+RET avi_writeFinish();
+RET avi_readStart(FIL *p_fil, uint32_t *p_frameMSec);
+RET avi_readFrameNext(uint32_t *p_frameSize);
+RET avi_readFinish();
+
+#endif /* SERVICE_AVI_H_ */
@@ -0,0 +1,307 @@
+/*
+ * exif.c
+ *
+ *  Created on: 2017/09/24
+ *      Author: take-iwiw
+ */
+#include <stdio.h>
+#include <string.h>
+#include <setjmp.h>
+#include "cmsis_os.h"
+#include "common.h"
+#include "applicationSettings.h"
+#include "ff.h"
+#include "jpeglib.h"
+#include "jpegFile.h"
+#include "jpegTable.h"
+#include "exif.h"
+
+/* APP1 (EXIF) segment with a small thumbnail, so that playback can show a picture without decoding the whole image */
+/* the thumbnail is made from YCbCr 4:2:0 rows passed to the main image (decimated by 4x4), */
+/*  and encoded by the same compress object after the main image is finished */
+/* the main image has a fixed size APP1 reserved by exif_writeApp1, which is over-written by exif_encodeThumbnail */
+/* APP1: "Exif\0\0", TIFF header, IFD0 (Orientation), IFD1 (thumbnail offset and length), thumbnail, padding */
+
+/*** Internal Const Values, Macros ***/
+#define LOG(str, ...) printf("[EXIF:%d] " str, __LINE__, ##__VA_ARGS__);
+#define LOG_E(str, ...) printf("[EXIF_ERR:%d] " str, __LINE__, ##__VA_ARGS__);
+
+#define EXIF_DECIMATION    4
+#define EXIF_THUMB_WIDTH   (IMAGE_SIZE_WIDTH / EXIF_DECIMATION)
+#define EXIF_THUMB_HEIGHT  (IMAGE_SIZE_HEIGHT / EXIF_DECIMATION)
+#define EXIF_THUMB_ROWS    ((EXIF_THUMB_HEIGHT + 15) / 16 * 16)   // libjpeg reads whole MCU rows in raw data mode
+#define EXIF_THUMB_BUFF_SIZE  (EXIF_THUMB_WIDTH * EXIF_THUMB_ROWS * 3 / 2)
+
+#define EXIF_TIFF_POS      6                          // "Exif\0\0"
+#define EXIF_IFD0_POS      8                          // from TIFF header
+#define EXIF_IFD1_POS      (EXIF_IFD0_POS + 2 + 12 * 1 + 4)
+#define EXIF_THUMB_POS     (EXIF_IFD1_POS + 2 + 12 * 3 + 4)
+#define EXIF_THUMB_MAX_SIZE  (EXIF_APP1_SIZE - EXIF_TIFF_POS - EXIF_THUMB_POS)
+
+#if EXIF_THUMBNAIL && !JPEG_ENCODE_RAW_YCBCR
+#error "EXIF_THUMBNAIL requires JPEG_ENCODE_RAW_YCBCR"
+#endif
+#if (IMAGE_SIZE_WIDTH % (EXIF_DECIMATION * 16) != 0)
+#error "thumbnail width must be a multiple of 16"
+#endif
+
+/*** Internal Static Variables ***/
+static uint8_t *sp_app1;         // EXIF_APP1_SIZE
+static uint8_t *sp_thumbBuff;    // Y[ROWS][W], Cb[ROWS/2][W/2], Cr[ROWS/2][W/2]
+static struct jpeg_destination_mgr *sp_thumbDest;   // allocated by libjpeg at the first thumbnail of the compress object
+static jmp_buf s_jmpBuf;
+
+/*** Internal Function Declarations ***/
+static void exif_makeApp1(uint32_t thumbSize);
+static void exif_setU16(uint8_t *p_buff, uint16_t val);
+static void exif_setU32(uint8_t *p_buff, uint32_t val);
+static void exif_setEntry(uint8_t *p_buff, uint16_t tag, uint16_t type, uint32_t val);
+static uint32_t exif_getU16(const uint8_t *p_buff, uint8_t isBigEndian);
+static uint32_t exif_getU32(const uint8_t *p_buff, uint8_t isBigEndian);
+static void exif_errorExit(j_common_ptr cinfo);
+
+/*** External Function Defines ***/
+/* call this after jpeg_create_compress */
+RET exif_start()
+{
+  sp_app1      = pvPortMalloc(EXIF_APP1_SIZE);
+  sp_thumbBuff = pvPortMalloc(EXIF_THUMB_BUFF_SIZE);
+  if( (sp_app1 == 0) || (sp_thumbBuff == 0) ) {
+    LOG_E("not enough memory\n");
+    exif_finish();
+    return RET_ERR_MEMORY;
+  }
+  sp_thumbDest = 0;
+  return RET_OK;
+}
+
+void exif_finish()
+{
+  vPortFree(sp_app1);
+  vPortFree(sp_thumbBuff);
+  sp_app1 = 0;
+  sp_thumbBuff = 0;
+}
+
+/* call this just after jpeg_start_compress (write_JFIF_header must be FALSE). APP1 without thumbnail is written */
+void exif_writeApp1(j_compress_ptr cinfo)
+{
+  exif_makeApp1(0);
+  jpeg_write_marker(cinfo, JPEG_APP0 + 1, sp_app1, EXIF_APP1_SIZE);
+}
+
+/* decimate one MCU row (Y: 16 rows, Cb, Cr: 8 rows of YCbCr 4:2:0) starting at line of the main image */
+void exif_addRows(JSAMPIMAGE image, uint32_t line)
+{
+  uint8_t *p_y  = sp_thumbBuff + EXIF_THUMB_WIDTH * (line / EXIF_DECIMATION);
+  uint8_t *p_cb = sp_thumbBuff + EXIF_THUMB_WIDTH * EXIF_THUMB_ROWS + (EXIF_THUMB_WIDTH / 2) * (line / 2 / EXIF_DECIMATION);
+  uint8_t *p_cr = p_cb + (EXIF_THUMB_WIDTH / 2) * (EXIF_THUMB_ROWS / 2);
+
+  /* average of 4x4 pixels */
+  for(uint32_t i = 0; i < 16; i += EXIF_DECIMATION) {
+    for(uint32_t x = 0; x < EXIF_THUMB_WIDTH; x++) {
+      uint32_t sum = 0;
+      for(uint32_t j = 0; j < EXIF_DECIMATION; j++) {
+        const JSAMPLE *p_src = image[0][i + j] + x * EXIF_DECIMATION;
+        sum += p_src[0] + p_src[1] + p_src[2] + p_src[3];
+      }
+      *p_y++ = sum / (EXIF_DECIMATION * EXIF_DECIMATION);
+    }
+  }
+  for(uint32_t i = 0; i < 8; i += EXIF_DECIMATION) {
+    for(uint32_t x = 0; x < EXIF_THUMB_WIDTH / 2; x++) {
+      uint32_t sumCb = 0, sumCr = 0;
+      for(uint32_t j = 0; j < EXIF_DECIMATION; j++) {
+        const JSAMPLE *p_srcCb = image[1][i + j] + x * EXIF_DECIMATION;
+        const JSAMPLE *p_srcCr = image[2][i + j] + x * EXIF_DECIMATION;
+        sumCb += p_srcCb[0] + p_srcCb[1] + p_srcCb[2] + p_srcCb[3];
+        sumCr += p_srcCr[0] + p_srcCr[1] + p_srcCr[2] + p_srcCr[3];
+      }
+      *p_cb++ = sumCb / (EXIF_DECIMATION * EXIF_DECIMATION);
+      *p_cr++ = sumCr / (EXIF_DECIMATION * EXIF_DECIMATION);
+    }
+  }
+}
+
+/*
+ * encode the thumbnail by the compress object of the main image (call this after jpeg_finish_compress)
+ * returns APP1 data (EXIF_APP1_SIZE bytes), which must be over-written at EXIF_APP1_POS of the main image
+ * if the thumbnail cannot be encoded (e.g. too large), APP1 without thumbnail is returned
+ */
+const uint8_t *exif_encodeThumbnail(j_compress_ptr cinfo, uint32_t qualityLevel)
+{
+  /* settings of the main image to be restored */
+  struct jpeg_destination_mgr *p_mainDest = cinfo->dest;
+  void (*mainErrorExit)(j_common_ptr) = cinfo->err->error_exit;
+  JDIMENSION mainWidth  = cinfo->image_width;
+  JDIMENSION mainHeight = cinfo->image_height;
+  int mainRestartRows   = cinfo->restart_in_rows;
+  volatile uint32_t thumbSize = 0;
+
+  /* pad rows below the image by the last row */
+  uint8_t *p_y  = sp_thumbBuff;
+  uint8_t *p_cb = p_y + EXIF_THUMB_WIDTH * EXIF_THUMB_ROWS;
+  uint8_t *p_cr = p_cb + (EXIF_THUMB_WIDTH / 2) * (EXIF_THUMB_ROWS / 2);
+  for(uint32_t i = EXIF_THUMB_HEIGHT; i < EXIF_THUMB_ROWS; i++) {
+    memcpy(p_y + EXIF_THUMB_WIDTH * i, p_y + EXIF_THUMB_WIDTH * (EXIF_THUMB_HEIGHT - 1), EXIF_THUMB_WIDTH);
+  }
+  for(uint32_t i = EXIF_THUMB_HEIGHT / 2; i < EXIF_THUMB_ROWS / 2; i++) {
+    memcpy(p_cb + (EXIF_THUMB_WIDTH / 2) * i, p_cb + (EXIF_THUMB_WIDTH / 2) * (EXIF_THUMB_HEIGHT / 2 - 1), EXIF_THUMB_WIDTH / 2);
+    memcpy(p_cr + (EXIF_THUMB_WIDTH / 2) * i, p_cr + (EXIF_THUMB_WIDTH / 2) * (EXIF_THUMB_HEIGHT / 2 - 1), EXIF_THUMB_WIDTH / 2);
+  }
+
+  if(setjmp(s_jmpBuf) == 0) {
+    cinfo->err->error_exit = exif_errorExit;
+    cinfo->dest = sp_thumbDest;
+    jpegFile_setDestMem(cinfo, sp_app1 + EXIF_TIFF_POS + EXIF_THUMB_POS, EXIF_THUMB_MAX_SIZE);
+    sp_thumbDest = cinfo->dest;
+    cinfo->image_width  = EXIF_THUMB_WIDTH;
+    cinfo->image_height = EXIF_THUMB_HEIGHT;
+    cinfo->restart_in_rows  = 0;  // no restart marker in the small reserved area
+    cinfo->restart_interval = 0;
+    jpegTable_setQuality(cinfo, qualityLevel);
+    jpeg_start_compress(cinfo, TRUE);
+
+    JSAMPROW rowY[16], rowCb[8], rowCr[8];
+    JSAMPARRAY image[3] = {rowY, rowCb, rowCr};
+    for(uint32_t y = 0; y < EXIF_THUMB_ROWS; y += 16) {
+      for(uint32_t i = 0; i < 16; i++) rowY[i] = p_y + EXIF_THUMB_WIDTH * (y + i);
+      for(uint32_t i = 0; i < 8; i++) {
+        rowCb[i] = p_cb + (EXIF_THUMB_WIDTH / 2) * (y / 2 + i);
+        rowCr[i] = p_cr + (EXIF_THUMB_WIDTH / 2) * (y / 2 + i);
+      }
+      jpeg_write_raw_data(cinfo, image, 16);
+    }
+    jpeg_finish_compress(cinfo);
+    thumbSize = jpegFile_getDestMemSize(cinfo);
+  } else {
+    /* the main image has been completed. just omit the thumbnail */
+    LOG_E("thumbnail is omitted (%d)\n", cinfo->err->msg_code);
+    jpeg_abort_compress(cinfo);
+    thumbSize = 0;
+  }
+
+  cinfo->dest = p_mainDest;
+  cinfo->err->error_exit = mainErrorExit;
+  cinfo->image_width  = mainWidth;
+  cinfo->image_height = mainHeight;
+  cinfo->restart_in_rows = mainRestartRows;   // restart_interval is calculated again at the next image
+
+  exif_makeApp1(thumbSize);
+  return sp_app1;
+}
+
+/*
+ * find the thumbnail in APP1 (EXIF) from the top of file (p_head)
+ * offset from the top of file and size of the thumbnail (JPEG) are returned
+ * IFD1 of files from other devices may be located beyond the head (then RET_NO_DATA is returned)
+ */
+RET exif_findThumbnail(const uint8_t *p_head, uint32_t size, uint32_t *p_offset, uint32_t *p_size)
+{
+  if( (size < 4) || (p_head[0] != 0xFF) || (p_head[1] != 0xD8) ) return RET_NO_DATA;
+
+  /* walk APPn segments */
+  uint32_t pos = 2;
+  while( (pos + 4 <= size) && (p_head[pos] == 0xFF) && ((p_head[pos + 1] & 0xF0) == 0xE0) ) {
+    uint32_t segmentSize = (p_head[pos + 2] << 8) | p_head[pos + 3];
+    if( (p_head[pos + 1] == 0xE1) && (pos + 4 + EXIF_TIFF_POS + EXIF_IFD0_POS <= size) && (memcmp(&p_head[pos + 4], "Exif\0\0", 6) == 0) ) {
+      uint32_t tiff = pos + 4 + EXIF_TIFF_POS;
+      uint8_t isBigEndian = (p_head[tiff] == 'M');
+      uint32_t ifd = exif_getU32(&p_head[tiff + 4], isBigEndian);
+      /* IFD0 -> IFD1 */
+      if(tiff + ifd + 2 > size) return RET_NO_DATA;
+      uint32_t entryNum = exif_getU16(&p_head[tiff + ifd], isBigEndian);
+      if(tiff + ifd + 2 + 12 * entryNum + 4 > size) return RET_NO_DATA;
+      ifd = exif_getU32(&p_head[tiff + ifd + 2 + 12 * entryNum], isBigEndian);
+      if( (ifd == 0) || (tiff + ifd + 2 > size) ) return RET_NO_DATA;
+      entryNum = exif_getU16(&p_head[tiff + ifd], isBigEndian);
+      if(tiff + ifd + 2 + 12 * entryNum > size) return RET_NO_DATA;
+
+      uint32_t thumbOffset = 0, thumbSize = 0;
+      for(uint32_t i = 0; i < entryNum; i++) {
+        const uint8_t *p_entry = &p_head[tiff + ifd + 2 + 12 * i];
+        uint32_t tag = exif_getU16(p_entry, isBigEndian);
+        if(tag == 0x0201) thumbOffset = exif_getU32(p_entry + 8, isBigEndian);  // JPEGInterchangeFormat
+        if(tag == 0x0202) thumbSize   = exif_getU32(p_entry + 8, isBigEndian);  // JPEGInterchangeFormatLength
+      }
+      if( (thumbOffset == 0) || (thumbSize == 0) ) return RET_NO_DATA;
+      *p_offset = tiff + thumbOffset;
+      *p_size   = thumbSize;
+      return RET_OK;
+    }
+    pos += 2 + segmentSize;
+  }
+  return RET_NO_DATA;
+}
+
+/*** Internal Function Defines ***/
+static void exif_makeApp1(uint32_t thumbSize)
+{
+  uint8_t *p_tiff = sp_app1 + EXIF_TIFF_POS;
+
+  memcpy(sp_app1, "Exif\0\0", 6);
+  /* TIFF header (little endian) */
+  p_tiff[0] = 'I';
+  p_tiff[1] = 'I';
+  exif_setU16(p_tiff + 2, 0x002A);
+  exif_setU32(p_tiff + 4, EXIF_IFD0_POS);
+  /* IFD0 */
+  exif_setU16(p_tiff + EXIF_IFD0_POS, 1);
+  exif_setEntry(p_tiff + EXIF_IFD0_POS + 2, 0x0112, 3, 1);   // Orientation = top-left
+  exif_setU32(p_tiff + EXIF_IFD0_POS + 2 + 12, (thumbSize > 0) ? EXIF_IFD1_POS : 0);
+  /* IFD1 */
+  exif_setU16(p_tiff + EXIF_IFD1_POS, 3);
+  exif_setEntry(p_tiff + EXIF_IFD1_POS + 2,  0x0103, 3, 6);  // Compression = JPEG
+  exif_setEntry(p_tiff + EXIF_IFD1_POS + 14, 0x0201, 4, EXIF_THUMB_POS);
+  exif_setEntry(p_tiff + EXIF_IFD1_POS + 26, 0x0202, 4, thumbSize);
+  exif_setU32(p_tiff + EXIF_IFD1_POS + 38, 0);
+  /* padding */
+  memset(p_tiff + EXIF_THUMB_POS + thumbSize, 0, EXIF_THUMB_MAX_SIZE - thumbSize);
+}
+
+static void exif_setU16(uint8_t *p_buff, uint16_t val)
+{
+  p_buff[0] = (val >> 0) & 0xFF;
+  p_buff[1] = (val >> 8) & 0xFF;
+}
+
+static void exif_setU32(uint8_t *p_buff, uint32_t val)
+{
+  p_buff[0] = (val >>  0) & 0xFF;
+  p_buff[1] = (val >>  8) & 0xFF;
+  p_buff[2] = (val >> 16) & 0xFF;
+  p_buff[3] = (val >> 24) & 0xFF;
+}
+
+/* type: 3 = SHORT, 4 = LONG. count is always 1 */
+static void exif_setEntry(uint8_t *p_buff, uint16_t tag, uint16_t type, uint32_t val)
+{
+  exif_setU16(p_buff + 0, tag);
+  exif_setU16(p_buff + 2, type);
+  exif_setU32(p_buff + 4, 1);
+  if(type == 3) {
+    exif_setU16(p_buff + 8, val);
+    exif_setU16(p_buff + 10, 0);
+  } else {
+    exif_setU32(p_buff + 8, val);
+  }
+}
+
+static uint32_t exif_getU16(const uint8_t *p_buff, uint8_t isBigEndian)
+{
+  if(isBigEndian) return (p_buff[0] << 8) | p_buff[1];
+  return p_buff[0] | (p_buff[1] << 8);
+}
+
+static uint32_t exif_getU32(const uint8_t *p_buff, uint8_t isBigEndian)
+{
+  if(isBigEndian) return (p_buff[0] << 24) | (p_buff[1] << 16) | (p_buff[2] << 8) | p_buff[3];
+  return p_buff[0] | (p_buff[1] << 8) | (p_buff[2] << 16) | (p_buff[3] << 24);
+}
+
+/* libjpeg error during thumbnail. go back to exif_encodeThumbnail */
+static void exif_errorExit(j_common_ptr cinfo)
+{
+  (*cinfo->err->output_message) (cinfo);
+  longjmp(s_jmpBuf, 1);
+}
@@ -0,0 +1,21 @@
+/*
+ * exif.h
+ *
+ *  Created on: 2017/09/24
+ *      Author: take-iwiw
+ */
+
+#ifndef SERVICE_EXIF_H_
+#define SERVICE_EXIF_H_
+
+#define EXIF_APP1_POS   6   // position of APP1 data from the top of image (after SOI, APP1 marker and length)
+#define EXIF_HEAD_SIZE  512 // bytes from the top of file to be passed to exif_findThumbnail
+
+RET exif_start();
+void exif_finish();
+void exif_writeApp1(j_compress_ptr cinfo);
+void exif_addRows(JSAMPIMAGE image, uint32_t line);
+const uint8_t *exif_encodeThumbnail(j_compress_ptr cinfo, uint32_t qualityLevel);
+RET exif_findThumbnail(const uint8_t *p_head, uint32_t size, uint32_t *p_offset, uint32_t *p_size);
+
+#endif /* SERVICE_EXIF_H_ */
@@ -5,14 +5,23 @@
  *      Author: take-iwiw
  */
 #include <stdio.h>
+#include <string.h>
 #include "cmsis_os.h"
 #include "main.h"
 #include "common.h"
 #include "commonMsg.h"
 #include "stm32f4xx_hal.h"
+#include "applicationSettings.h"
 #include "ff.h"
+#include "fileNumber.h"
+
+/* the volume is shared by all modes and tasks. it is mounted at the first use, and kept mounted */
+/* so that the FAT window and the free cluster count (FSInfo) read from the card are kept between pictures */
+/* it is unmounted only by file_deinit (explicit request, or a disk error e.g. the card has been removed) */
 
 /*** Internal Const Values, Macros ***/
+#define LOG(str, ...) printf("[FILE:%d] " str, __LINE__, ##__VA_ARGS__);
+#define LOG_E(str, ...) printf("[FILE_ERR:%d] " str, __LINE__, ##__VA_ARGS__);
 
 /*** Internal Static Variables ***/
 static FATFS s_fatFs;
@@ -20,61 +29,184 @@ static DIR s_dir;
 static FIL s_fil;
 static uint8_t s_isInitDone = 0;
 
+/* seeking from the root continues to folders in FILENAME_DIR_ROOT (DCF) */
+/* s_dir and s_subDir are open together with the file loaded by playback (3 objects. _FS_LOCK in ffconf.h must be >= 3) */
+static char    s_dirPath[FILENAME_PATH_SIZE];     // path of s_dir ("" for the root)
+static uint8_t s_isDirOpen = 0;
+static uint8_t s_isSeekingDcf = 0;                // s_dir is FILENAME_DIR_ROOT after the root
+static DIR     s_subDir;                          // a folder in FILENAME_DIR_ROOT
+static char    s_subDirPath[FILENAME_PATH_SIZE];
+static uint8_t s_isSubDirOpen = 0;
+
 /*** Internal Function Declarations ***/
+static void file_makePath(char *p_path, const char *p_dirPath, const char *p_name);
+static void file_checkDiskError(FRESULT ret);
 
 /*** External Function Defines ***/
+/* mount the volume if not yet. the card is accessed at the first file operation */
 RET file_init()
 {
   FRESULT ret;
-  f_mount(0, "", 0);
+  if(s_isInitDone) return RET_OK;
   ret = f_mount(&s_fatFs, "", 0);
   if(ret != FR_OK) return RET_ERR_FILE;
   s_isInitDone = 1;
   return RET_OK;
 }
+
+/* unmount the volume (files must be closed). it is mounted again by the next file_init */
 RET file_deinit()
 {
   FRESULT ret;
   ret = f_mount(0, "", 0);
   if(ret != FR_OK) return RET_ERR_FILE;
   s_isInitDone = 0;
+  fileNumber_reset();   // the next card may have other files
   return RET_OK;
 }
 
+/*
+ * open a file on the shared volume. FIL is allocated from the heap, and freed by file_close
+ * the result of f_open is returned (*pp_fil = 0 if not opened)
+ */
+FRESULT file_open(FIL **pp_fil, const char *path, BYTE mode)
+{
+  FRESULT ret;
+  *pp_fil = 0;
+  if(file_init() != RET_OK) return FR_NOT_ENABLED;
+  FIL *p_fil = pvPortMalloc(sizeof(FIL));
+  if(p_fil == 0) return FR_NOT_ENOUGH_CORE;
+
+  ret = f_open(p_fil, path, mode);
+  if(ret != FR_OK) {
+    vPortFree(p_fil);
+    file_checkDiskError(ret);
+    return ret;
+  }
+  *pp_fil = p_fil;
+  return FR_OK;
+}
+
+FRESULT file_close(FIL *p_fil)
+{
+  if(p_fil == 0) return FR_INVALID_OBJECT;
+  FRESULT ret = f_close(p_fil);
+  vPortFree(p_fil);
+  file_checkDiskError(ret);
+  return ret;
+}
+
+/*
+ * allocate clusters for size bytes from the current position, so that writing in this area does not update FAT
+ * size is clipped by the free space leaving reserveSize. the allocated size is returned by p_size
+ * clusters are taken next to the last allocated one, so they are contiguous unless the free space is fragmented
+ * the position is not changed. cut the rest by file_truncate after writing
+ */
+FRESULT file_preallocate(FIL *p_fil, uint32_t size, uint32_t reserveSize, uint32_t *p_size)
+{
+  FRESULT ret;
+  FATFS *p_fs;
+  DWORD freeClusters;
+  uint32_t pos = f_tell(p_fil);
+  *p_size = 0;
+
+  /* FAT is scanned only the first time after mount (on FAT16), then the count is kept by FatFs */
+  ret = f_getfree("", &freeClusters, &p_fs);
+  if(ret != FR_OK) {
+    file_checkDiskError(ret);
+    return ret;
+  }
+  uint64_t freeSize = (uint64_t)freeClusters * p_fs->csize * _MIN_SS;
+  if(freeSize <= reserveSize) return FR_OK;
+  if(size > freeSize - reserveSize) size = freeSize - reserveSize;
+
+  /* seeking beyond the end expands the file (data are not written) */
+  ret = f_lseek(p_fil, pos + size);
+  if(ret == FR_OK) {
+    *p_size = f_tell(p_fil) - pos;
+    ret = f_lseek(p_fil, pos);
+  }
+  /* write FAT and the directory entry now, not during recording */
+  if(ret == FR_OK) ret = f_sync(p_fil);
+  file_checkDiskError(ret);
+  return ret;
+}
+
+/* cut the file at the current position (e.g. the rest of the area allocated by file_preallocate) */
+FRESULT file_truncate(FIL *p_fil)
+{
+  FRESULT ret = f_truncate(p_fil);
+  file_checkDiskError(ret);
+  return ret;
+}
+
+/* path = "/" (or 0) seeks files in the root, then in folders of FILENAME_DIR_ROOT */
 RET file_seekStart(const char* path)
 {
   FRESULT ret = 0;
   if(s_isInitDone == 0) ret = file_init();
-  if(path == 0 || path[0] == 0) {
+  s_isSeekingDcf = 0;
+  if(path == 0 || path[0] == 0 || strcmp(path, "/") == 0) {
+    s_dirPath[0] = '\0';
     ret |= f_opendir(&s_dir, "/");
   } else {
+    strcpy(s_dirPath, path);
     ret |= f_opendir(&s_dir, path);
   }
   if(ret != FR_OK) return RET_ERR_FILE;
+  s_isDirOpen = 1;
   return RET_OK;
 }
 
 RET file_seekStop()
 {
-  FRESULT ret;
-  ret = f_closedir(&s_dir);
+  FRESULT ret = FR_OK;
+  if(s_isSubDirOpen) ret |= f_closedir(&s_subDir);
+  if(s_isDirOpen) ret |= f_closedir(&s_dir);
+  s_isSubDirOpen = 0;
+  s_isDirOpen = 0;
   if(ret != FR_OK) return RET_ERR_FILE;
   return RET_OK;
 }
 
+/* filename is a path from the root (FILENAME_PATH_SIZE bytes) */
 RET file_seekFileNext(char* filename)
 {
   FRESULT ret;
   FILINFO fileinfo;
   while(1){
-    ret = f_readdir(&s_dir, &fileinfo);
+    if (!s_isDirOpen) return RET_NO_DATA;
+    DIR *p_dir = s_isSubDirOpen ? &s_subDir : &s_dir;
+    ret = f_readdir(p_dir, &fileinfo);
     if (ret != FR_OK) return RET_ERR_FILE;
-    if (fileinfo.fname[0] == 0) return RET_NO_DATA;
+    if (fileinfo.fname[0] == 0) {
+      if (s_isSubDirOpen) {
+        /* next folder in FILENAME_DIR_ROOT */
+        f_closedir(&s_subDir);
+        s_isSubDirOpen = 0;
+        continue;
+      }
+      if ( (s_dirPath[0] == '\0') && !s_isSeekingDcf ) {
+        /* end of the root. go to FILENAME_DIR_ROOT */
+        f_closedir(&s_dir);
+        s_isSeekingDcf = 1;
+        strcpy(s_dirPath, FILENAME_DIR_ROOT);
+        s_isDirOpen = (f_opendir(&s_dir, s_dirPath) == FR_OK);
+        continue;
+      }
+      return RET_NO_DATA;
+    }
     if (fileinfo.fname[0] == '.') continue;
     if ( (fileinfo.fattrib & AM_SYS) == AM_SYS ) continue;
-    if (fileinfo.fattrib & AM_DIR) continue;
+    if (fileinfo.fattrib & AM_DIR) {
+      if (s_isSeekingDcf && !s_isSubDirOpen) {
+        file_makePath(s_subDirPath, s_dirPath, fileinfo.fname);
+        s_isSubDirOpen = (f_opendir(&s_subDir, s_subDirPath) == FR_OK);
+      }
+      continue;
+    }
 
-    strcpy(filename, fileinfo.fname);
+    file_makePath(filename, s_isSubDirOpen ? s_subDirPath : s_dirPath, fileinfo.fname);
     break;
   }
   return RET_OK;
@@ -86,7 +218,10 @@ RET file_loadStart(char* filename)
   if(s_isInitDone == 0)ret = file_init();
   ret |= f_open(&s_fil, filename, FA_READ);
 
-  if(ret != FR_OK) return RET_ERR_FILE;
+  if(ret != FR_OK) {
+    file_checkDiskError(ret);
+    return RET_ERR_FILE;
+  }
   return RET_OK;
 }
 
@@ -113,3 +248,22 @@ FIL* file_loadGetCurrentFil()
 }
 
 /*** Internal Function Defines ***/
+/* the card may have been removed or changed. mount it again at the next use */
+static void file_checkDiskError(FRESULT ret)
+{
+  if( (ret == FR_DISK_ERR) || (ret == FR_NOT_READY) || (ret == FR_NO_FILESYSTEM) ) {
+    LOG_E("disk error %d. unmount\n", ret);
+    file_deinit();
+  }
+}
+
+static void file_makePath(char *p_path, const char *p_dirPath, const char *p_name)
+{
+  if(p_dirPath[0] == '\0') {
+    strcpy(p_path, p_name);
+  } else {
+    strcpy(p_path, p_dirPath);
+    strcat(p_path, "/");
+    strcat(p_path, p_name);
+  }
+}
@@ -10,6 +10,10 @@
 
 RET file_init();
 RET file_deinit();
+FRESULT file_open(FIL **pp_fil, const char *path, BYTE mode);
+FRESULT file_close(FIL *p_fil);
+FRESULT file_preallocate(FIL *p_fil, uint32_t size, uint32_t reserveSize, uint32_t *p_size);
+FRESULT file_truncate(FIL *p_fil);
 RET file_seekStart(const char* path);
 RET file_seekStop();
 RET file_seekFileNext(char* filename);
@@ -0,0 +1,174 @@
+/*
+ * fileNumber.c
+ *
+ *  Created on: 2017/09/28
+ *      Author: take-iwiw
+ */
+#include <stdio.h>
+#include <string.h>
+#include "cmsis_os.h"
+#include "common.h"
+#include "applicationSettings.h"
+#include "ff.h"
+#include "fileNumber.h"
+
+/* file numbers for new pictures and movies, in DCF style folders (e.g. DCIM/100STM32/IMG000.JPG) */
+/* the last folder is scanned only once, then numbers are given from RAM without accessing the card */
+/* numbers are shared by all prefixes and extensions. a new folder is made after number 999 */
+
+/*** Internal Const Values, Macros ***/
+#define LOG(str, ...) printf("[FILE_NUMBER:%d] " str, __LINE__, ##__VA_ARGS__);
+#define LOG_E(str, ...) printf("[FILE_NUMBER_ERR:%d] " str, __LINE__, ##__VA_ARGS__);
+
+#define FILE_NUMBER_DIR_MIN   100
+#define FILE_NUMBER_DIR_MAX   999
+#define FILE_NUMBER_FILE_MAX  999
+
+/*** Internal Static Variables ***/
+static uint8_t  s_isScanned = 0;
+static uint8_t  s_isDirCreated;   // the current folder exists on the card
+static uint32_t s_dirNumber;      // number of the current folder
+static uint32_t s_fileNumber;     // next number in the current folder
+
+/*** Internal Function Declarations ***/
+static RET fileNumber_scan();
+static int32_t fileNumber_parse(const char *p_str);
+static void fileNumber_put(char *p_str, uint32_t number);
+static void fileNumber_makeDirPath(char *p_path, uint32_t dirNumber);
+
+/*** External Function Defines ***/
+/* scan the card (the volume must be mounted by file_init). if this fails, the card is scanned at the next fileNumber_getNext */
+RET fileNumber_init()
+{
+  s_isScanned = 0;
+  return fileNumber_scan();
+}
+
+/*
+ * p_path has a filename (e.g. "IMG000.JPG") with 3 digits at numPos, and FILENAME_PATH_SIZE bytes
+ * the path of the next file (e.g. "DCIM/100STM32/IMG001.JPG") is returned by p_path. the folder is made if needed
+ * the volume must be mounted (file_init)
+ */
+RET fileNumber_getNext(char *p_path, uint32_t numPos)
+{
+  char filename[13];
+  FRESULT ret;
+
+  if(!s_isScanned) {
+    if(fileNumber_scan() != RET_OK) return RET_ERR_FILE;
+  }
+
+  if(s_fileNumber > FILE_NUMBER_FILE_MAX) {
+    s_dirNumber++;
+    s_fileNumber   = 0;
+    s_isDirCreated = 0;
+  }
+  if(s_dirNumber > FILE_NUMBER_DIR_MAX) {
+    LOG_E("no more number\n");
+    return RET_ERR_OF;
+  }
+
+  strcpy(filename, p_path);
+  fileNumber_makeDirPath(p_path, s_dirNumber);
+  if(!s_isDirCreated) {
+    ret = f_mkdir(FILENAME_DIR_ROOT);
+    if( (ret == FR_OK) || (ret == FR_EXIST) ) ret = f_mkdir(p_path);
+    if( (ret != FR_OK) && (ret != FR_EXIST) ) {
+      LOG_E("mkdir %s: %d\n", p_path, ret);
+      return RET_ERR_FILE;
+    }
+    s_isDirCreated = 1;
+  }
+
+  fileNumber_put(&filename[numPos], s_fileNumber);
+  strcat(p_path, "/");
+  strcat(p_path, filename);
+  s_fileNumber++;
+
+  return RET_OK;
+}
+
+/* scan the card again at the next fileNumber_getNext (e.g. the card may have been changed) */
+void fileNumber_reset()
+{
+  s_isScanned = 0;
+}
+
+/*** Internal Function Defines ***/
+/* find the last folder in FILENAME_DIR_ROOT, and the last number in it */
+static RET fileNumber_scan()
+{
+  DIR dir;
+  FILINFO fileinfo;
+  FRESULT ret;
+  char path[FILENAME_PATH_SIZE];
+  int32_t maxDirNumber = -1;
+  uint8_t isMaxDirMine = 0;
+
+  s_dirNumber    = FILE_NUMBER_DIR_MIN;
+  s_fileNumber   = 0;
+  s_isDirCreated = 0;
+
+  ret = f_opendir(&dir, FILENAME_DIR_ROOT);
+  if(ret == FR_NO_PATH) {
+    /* no picture yet */
+    s_isScanned = 1;
+    return RET_OK;
+  }
+  if(ret != FR_OK) return RET_ERR_FILE;
+  while( (f_readdir(&dir, &fileinfo) == FR_OK) && (fileinfo.fname[0] != 0) ) {
+    if( !(fileinfo.fattrib & AM_DIR) ) continue;
+    int32_t number = fileNumber_parse(fileinfo.fname);
+    if( (number < FILE_NUMBER_DIR_MIN) || (number < maxDirNumber) ) continue;
+    maxDirNumber = number;
+    isMaxDirMine = (strcmp(&fileinfo.fname[3], FILENAME_DIR_NAME) == 0);
+  }
+  f_closedir(&dir);
+
+  if(maxDirNumber < 0) {
+    /* no folder yet */
+  } else if(!isMaxDirMine) {
+    /* folder numbers are shared with other devices */
+    s_dirNumber = maxDirNumber + 1;
+  } else {
+    s_dirNumber    = maxDirNumber;
+    s_isDirCreated = 1;
+    fileNumber_makeDirPath(path, s_dirNumber);
+    if(f_opendir(&dir, path) != FR_OK) return RET_ERR_FILE;
+    while( (f_readdir(&dir, &fileinfo) == FR_OK) && (fileinfo.fname[0] != 0) ) {
+      if( (fileinfo.fattrib & AM_DIR) || (strlen(fileinfo.fname) < FILENAME_NUM_POS + 3) ) continue;
+      int32_t number = fileNumber_parse(&fileinfo.fname[FILENAME_NUM_POS]);
+      if(number >= (int32_t)s_fileNumber) s_fileNumber = number + 1;
+    }
+    f_closedir(&dir);
+  }
+
+  LOG("next = %d/%03d\n", s_dirNumber, s_fileNumber);
+  s_isScanned = 1;
+  return RET_OK;
+}
+
+/* 3 digits at the top of p_str. -1 if they are not digits */
+static int32_t fileNumber_parse(const char *p_str)
+{
+  int32_t number = 0;
+  for(uint32_t i = 0; i < 3; i++) {
+    if( (p_str[i] < '0') || (p_str[i] > '9') ) return -1;
+    number = number * 10 + (p_str[i] - '0');
+  }
+  return number;
+}
+
+static void fileNumber_put(char *p_str, uint32_t number)
+{
+  p_str[0] = '0' + (number / 100) % 10;
+  p_str[1] = '0' + (number / 10) % 10;
+  p_str[2] = '0' + (number / 1) % 10;
+}
+
+/* e.g. "DCIM/100STM32" */
+static void fileNumber_makeDirPath(char *p_path, uint32_t dirNumber)
+{
+  strcpy(p_path, FILENAME_DIR_ROOT "/000" FILENAME_DIR_NAME);
+  fileNumber_put(&p_path[sizeof(FILENAME_DIR_ROOT)], dirNumber);
+}
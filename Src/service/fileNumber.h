@@ -0,0 +1,15 @@
+/*
+ * fileNumber.h
+ *
+ *  Created on: 2017/09/28
+ *      Author: take-iwiw
+ */
+
+#ifndef SERVICE_FILENUMBER_H_
+#define SERVICE_FILENUMBER_H_
+
+RET fileNumber_init();
+RET fileNumber_getNext(char *p_path, uint32_t numPos);
+void fileNumber_reset();
+
+#endif /* SERVICE_FILENUMBER_H_ */
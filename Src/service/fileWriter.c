@@ -0,0 +1,337 @@
+/*
+ * fileWriter.c
+ *
+ *  Created on: 2017/09/19
+ *      Author: take-iwiw
+ */
+#include <stdio.h>
+#include <string.h>
+#include "cmsis_os.h"
+#include "common.h"
+#include "commonMsg.h"
+#include "applicationSettings.h"
+#include "ff.h"
+#include "perf.h"
+#include "fileWriter.h"
+
+/* writes data to a file in FileWriter task, so that SD card latency does not block the caller (encoder) */
+/* the caller fills a buffer and queues it. it is blocked only when all buffers are waiting for SD card */
+/* while the writer is running, the file must be accessed only through this module */
+/* whole files can also be saved from buffers of the caller (e.g. burst shooting) by fileWriter_saveFile */
+
+/*** Internal Const Values, Macros ***/
+#define LOG(str, ...) printf("[FILE_WRITER:%d] " str, __LINE__, ##__VA_ARGS__);
+#define LOG_E(str, ...) printf("[FILE_WRITER_ERR:%d] " str, __LINE__, ##__VA_ARGS__);
+
+#define FILE_WRITER_BUFF_NUM   MOVIE_WRITER_BUFF_NUM
+#define FILE_WRITER_BUFF_SIZE  MOVIE_WRITER_BUFF_SIZE
+
+typedef enum {
+  FILE_WRITER_JOB_WRITE,    // write p_data to p_fil
+  FILE_WRITER_JOB_PATCH,    // over-write p_data at pos of p_fil, then go back to the current position
+  FILE_WRITER_JOB_SYNC,     // notify the caller that all jobs before this have been done
+  FILE_WRITER_JOB_FLUSH,    // f_sync p_fil (cached data and directory entry are written to the card)
+  FILE_WRITER_JOB_SAVE,     // create p_name and write p_ext into it, then return p_ext to doneQueueId
+} FILE_WRITER_JOB_TYPE;
+
+typedef struct {
+  FILE_WRITER_JOB_TYPE type;
+  FIL      *p_fil;
+  uint32_t pos;
+  uint32_t size;
+  uint8_t  *p_data;   // FILE_WRITER_BUFF_SIZE bytes owned by this job
+  uint8_t  *p_ext;    // buffer of the caller (FILE_WRITER_JOB_SAVE)
+  const char   *p_name;
+  osMessageQId doneQueueId;
+} FILE_WRITER_JOB;
+
+/*** Internal Static Variables ***/
+static FILE_WRITER_JOB s_jobs[FILE_WRITER_BUFF_NUM];
+static uint8_t         *sp_buffers;
+static uint8_t         s_isStarted;
+static FIL             *sp_fil;         // main file
+static FIL             s_filSave;       // file being saved by FILE_WRITER_JOB_SAVE
+static uint32_t        s_pos;           // position of the main file after all queued jobs are done
+static osMessageQId    s_freeQueueId;   // jobs which can be used by the caller
+static osSemaphoreId   s_syncSemId;
+static volatile RET    s_error;
+
+/* statistics */
+static uint32_t s_maxQueuedNum;
+static uint32_t s_stallNum;
+static uint32_t s_stallMSec;
+static uint32_t s_maxStallMSec;
+static volatile uint32_t s_writeNum;
+static volatile uint32_t s_writeMSec;
+static volatile uint32_t s_maxWriteMSec;
+
+/*** Internal Function Declarations ***/
+static FILE_WRITER_JOB *fileWriter_allocJob();
+static void fileWriter_putJob(FILE_WRITER_JOB *p_job);
+static void fileWriter_doJob(FILE_WRITER_JOB *p_job);
+
+/*** External Function Defines ***/
+void fileWriter_task(void const * argument)
+{
+  LOG("task start\n");
+  osMessageQId myQueueId = getQueueId(FILE_WRITER);
+
+  while(1) {
+    osEvent event;
+    event = osMessageGet(myQueueId, osWaitForever);
+    if (event.status == osEventMessage) {
+      FILE_WRITER_JOB *p_job = event.value.p;
+      FILE_WRITER_JOB_TYPE type = p_job->type;
+      uint8_t *p_ext = p_job->p_ext;
+      osMessageQId doneQueueId = p_job->doneQueueId;
+      fileWriter_doJob(p_job);
+      osMessagePut(s_freeQueueId, (uint32_t)p_job, 0);
+      if(type == FILE_WRITER_JOB_SYNC) osSemaphoreRelease(s_syncSemId);
+      if(type == FILE_WRITER_JOB_SAVE) osMessagePut(doneQueueId, (uint32_t)p_ext, 0);   // returned even if failed
+    }
+  }
+}
+
+/* data for p_fil will be written by FileWriter task until fileWriter_finish */
+/* p_fil = 0 starts the writer without the main file (only fileWriter_saveFile is used. no buffer is allocated) */
+RET fileWriter_start(FIL *p_fil)
+{
+  if(s_freeQueueId == 0) {
+    osMessageQDef(FileWriterFree, FILE_WRITER_BUFF_NUM, uint32_t);
+    s_freeQueueId = osMessageCreate(osMessageQ(FileWriterFree), NULL);
+    osSemaphoreDef(FileWriterSync);
+    s_syncSemId = osSemaphoreCreate(osSemaphore(FileWriterSync), 1);
+    osSemaphoreWait(s_syncSemId, 0);  // created as available
+    if( (s_freeQueueId == 0) || (s_syncSemId == 0) ) return RET_ERR_MEMORY;
+  }
+
+  if(p_fil != 0) {
+    sp_buffers = pvPortMalloc(FILE_WRITER_BUFF_NUM * FILE_WRITER_BUFF_SIZE);
+    if(sp_buffers == 0) {
+      LOG_E("not enough memory\n");
+      return RET_ERR_MEMORY;
+    }
+  }
+  for(uint32_t i = 0; i < FILE_WRITER_BUFF_NUM; i++) {
+    s_jobs[i].p_data = (sp_buffers != 0) ? sp_buffers + FILE_WRITER_BUFF_SIZE * i : 0;
+    osMessagePut(s_freeQueueId, (uint32_t)&s_jobs[i], 0);
+  }
+
+  s_isStarted = 1;
+  sp_fil = p_fil;
+  s_pos  = (p_fil != 0) ? f_tell(p_fil) : 0;
+  s_error = RET_OK;
+
+  s_maxQueuedNum = 0;
+  s_stallNum     = 0;
+  s_stallMSec    = 0;
+  s_maxStallMSec = 0;
+  s_writeNum     = 0;
+  s_writeMSec    = 0;
+  s_maxWriteMSec = 0;
+
+  return RET_OK;
+}
+
+/* wait until all data are written, then release buffers. the file can be accessed directly after this */
+RET fileWriter_finish()
+{
+  RET ret;
+  if(!s_isStarted) return RET_DO_NOTHING;
+
+  ret = fileWriter_sync();
+  fileWriter_showStats();
+
+  /* a buffer taken by a caller which was aborted may be missing, so do not wait */
+  while(osMessageGet(s_freeQueueId, 0).status == osEventMessage);
+  vPortFree(sp_buffers);
+  sp_buffers = 0;
+  sp_fil = 0;
+  s_isStarted = 0;
+
+  return ret;
+}
+
+/* get an empty buffer (fileWriter_getBufferSize() bytes). the caller must pass it to fileWriter_write */
+uint8_t *fileWriter_getBuffer()
+{
+  return fileWriter_allocJob()->p_data;
+}
+
+uint32_t fileWriter_getBufferSize()
+{
+  return FILE_WRITER_BUFF_SIZE;
+}
+
+/* queue a buffer got by fileWriter_getBuffer to be written to the main file. size = 0 just returns the buffer */
+RET fileWriter_write(uint8_t *p_buff, uint32_t size)
+{
+  FILE_WRITER_JOB *p_job = &s_jobs[(p_buff - sp_buffers) / FILE_WRITER_BUFF_SIZE];
+
+  if(size == 0) {
+    osMessagePut(s_freeQueueId, (uint32_t)p_job, 0);
+    return s_error;
+  }
+  p_job->type  = FILE_WRITER_JOB_WRITE;
+  p_job->p_fil = sp_fil;
+  p_job->size  = size;
+  s_pos += size;
+  fileWriter_putJob(p_job);
+  return s_error;
+}
+
+/* copy small data and queue it. p_fil = 0 means the main file */
+RET fileWriter_writeData(FIL *p_fil, const void *p_data, uint32_t size)
+{
+  if(size > FILE_WRITER_BUFF_SIZE) return RET_ERR_PARAM;
+  if(size == 0) return s_error;
+
+  FILE_WRITER_JOB *p_job = fileWriter_allocJob();
+  memcpy(p_job->p_data, p_data, size);
+  p_job->type  = FILE_WRITER_JOB_WRITE;
+  p_job->p_fil = (p_fil == 0) ? sp_fil : p_fil;
+  p_job->size  = size;
+  if(p_job->p_fil == sp_fil) s_pos += size;
+  fileWriter_putJob(p_job);
+  return s_error;
+}
+
+/* over-write data already queued (e.g. size field of a header) in the main file */
+RET fileWriter_patch(uint32_t pos, const void *p_data, uint32_t size)
+{
+  if(size > FILE_WRITER_BUFF_SIZE) return RET_ERR_PARAM;
+
+  FILE_WRITER_JOB *p_job = fileWriter_allocJob();
+  memcpy(p_job->p_data, p_data, size);
+  p_job->type  = FILE_WRITER_JOB_PATCH;
+  p_job->p_fil = sp_fil;
+  p_job->pos   = pos;
+  p_job->size  = size;
+  fileWriter_putJob(p_job);
+  return s_error;
+}
+
+/* create filename and write p_data into it in FileWriter task. p_data is not copied */
+/* p_data is put to doneQueueId when the file is closed (or failed), and filename must be kept until then */
+RET fileWriter_saveFile(const char *filename, uint8_t *p_data, uint32_t size, osMessageQId doneQueueId)
+{
+  FILE_WRITER_JOB *p_job = fileWriter_allocJob();
+  p_job->type   = FILE_WRITER_JOB_SAVE;
+  p_job->p_name = filename;
+  p_job->p_ext  = p_data;
+  p_job->size   = size;
+  p_job->doneQueueId = doneQueueId;
+  fileWriter_putJob(p_job);
+  return s_error;
+}
+
+/* write cached data and the file size of the main file to the card after all queued jobs, without waiting */
+/* data written before this survive power loss */
+RET fileWriter_flush()
+{
+  FILE_WRITER_JOB *p_job = fileWriter_allocJob();
+  p_job->type  = FILE_WRITER_JOB_FLUSH;
+  p_job->p_fil = sp_fil;
+  p_job->size  = 0;
+  fileWriter_putJob(p_job);
+  return s_error;
+}
+
+/* wait until all queued jobs are done */
+RET fileWriter_sync()
+{
+  FILE_WRITER_JOB *p_job = fileWriter_allocJob();
+  p_job->type = FILE_WRITER_JOB_SYNC;
+  fileWriter_putJob(p_job);
+  osSemaphoreWait(s_syncSemId, osWaitForever);
+  return s_error;
+}
+
+/* position of the main file when all queued data are written */
+uint32_t fileWriter_tell()
+{
+  return s_pos;
+}
+
+/* the first error in FileWriter task. data after an error are discarded */
+RET fileWriter_getError()
+{
+  return s_error;
+}
+
+void fileWriter_showStats()
+{
+  LOG("queue max = %d/%d, stall = %d times %d msec (max %d)\n", s_maxQueuedNum, FILE_WRITER_BUFF_NUM, s_stallNum, s_stallMSec, s_maxStallMSec);
+  if(s_writeNum > 0) {
+    LOG("write = %d times, avg %d msec (max %d)\n", s_writeNum, s_writeMSec / s_writeNum, s_maxWriteMSec);
+  }
+}
+
+/*** Internal Function Defines ***/
+static FILE_WRITER_JOB *fileWriter_allocJob()
+{
+  osEvent event = osMessageGet(s_freeQueueId, 0);
+  if(event.status != osEventMessage) {
+    /* all buffers are waiting for SD card */
+    uint32_t start = HAL_GetTick();
+    event = osMessageGet(s_freeQueueId, osWaitForever);
+    uint32_t stall = HAL_GetTick() - start;
+    s_stallNum++;
+    s_stallMSec += stall;
+    if(stall > s_maxStallMSec) s_maxStallMSec = stall;
+  }
+  return event.value.p;
+}
+
+static void fileWriter_putJob(FILE_WRITER_JOB *p_job)
+{
+  osMessagePut(getQueueId(FILE_WRITER), (uint32_t)p_job, osWaitForever);
+  uint32_t queuedNum = FILE_WRITER_BUFF_NUM - osMessageWaiting(s_freeQueueId);
+  if(queuedNum > s_maxQueuedNum) s_maxQueuedNum = queuedNum;
+}
+
+static void fileWriter_doJob(FILE_WRITER_JOB *p_job)
+{
+  FRESULT ret = FR_OK;
+  UINT num = p_job->size;
+  uint32_t start = HAL_GetTick();
+
+  if(s_error != RET_OK) return;   // e.g. disk full. discard the following data
+
+  PERF_START(perfStart);
+  switch(p_job->type) {
+  case FILE_WRITER_JOB_WRITE:
+    ret = f_write(p_job->p_fil, p_job->p_data, p_job->size, &num);
+    break;
+  case FILE_WRITER_JOB_PATCH: {
+    uint32_t currentPos = f_tell(p_job->p_fil);
+    ret  = f_lseek(p_job->p_fil, p_job->pos);
+    ret |= f_write(p_job->p_fil, p_job->p_data, p_job->size, &num);
+    ret |= f_lseek(p_job->p_fil, currentPos);
+    break;
+  }
+  case FILE_WRITER_JOB_SAVE:
+    ret = f_open(&s_filSave, p_job->p_name, FA_WRITE | FA_CREATE_NEW);
+    if(ret == FR_OK) {
+      ret  = f_write(&s_filSave, p_job->p_ext, p_job->size, &num);
+      ret |= f_close(&s_filSave);
+    }
+    break;
+  case FILE_WRITER_JOB_FLUSH:
+    ret = f_sync(p_job->p_fil);
+    break;
+  default:
+    return;
+  }
+  PERF_STOP(PERF_WRITE, perfStart);
+
+  if( (ret != FR_OK) || (num != p_job->size) ) {
+    LOG_E("%d %d/%d\n", ret, num, p_job->size);
+    s_error = RET_ERR_FILE;
+  }
+
+  uint32_t time = HAL_GetTick() - start;
+  s_writeNum++;
+  s_writeMSec += time;
+  if(time > s_maxWriteMSec) s_maxWriteMSec = time;
+}
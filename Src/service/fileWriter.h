@@ -0,0 +1,25 @@
+/*
+ * fileWriter.h
+ *
+ *  Created on: 2017/09/19
+ *      Author: take-iwiw
+ */
+
+#ifndef SERVICE_FILEWRITER_H_
+#define SERVICE_FILEWRITER_H_
+
+RET fileWriter_start(FIL *p_fil);
+RET fileWriter_finish();
+uint8_t *fileWriter_getBuffer();
+uint32_t fileWriter_getBufferSize();
+RET fileWriter_write(uint8_t *p_buff, uint32_t size);
+RET fileWriter_writeData(FIL *p_fil, const void *p_data, uint32_t size);
+RET fileWriter_patch(uint32_t pos, const void *p_data, uint32_t size);
+RET fileWriter_saveFile(const char *filename, uint8_t *p_data, uint32_t size, osMessageQId doneQueueId);
+RET fileWriter_flush();
+RET fileWriter_sync();
+uint32_t fileWriter_tell();
+RET fileWriter_getError();
+void fileWriter_showStats();
+
+#endif /* SERVICE_FILEWRITER_H_ */
@@ -0,0 +1,158 @@
+/*
+ * frameRing.c
+ *
+ *  Created on: 2017/09/26
+ *      Author: take-iwiw
+ */
+#include <stdio.h>
+#include "cmsis_os.h"
+#include "common.h"
+#include "frameRing.h"
+
+/* ring of compressed frames (e.g. JPEG) in one buffer from the heap. the oldest frames are overwritten by new ones */
+/* each frame is stored contiguously, so that it can be encoded into the ring directly */
+/* usage: frameRing_getWriteBuffer -> encode -> frameRing_commit, then frameRing_pop from the oldest */
+
+/*** Internal Const Values, Macros ***/
+#define LOG(str, ...) printf("[FRAME_RING:%d] " str, __LINE__, ##__VA_ARGS__);
+#define LOG_E(str, ...) printf("[FRAME_RING_ERR:%d] " str, __LINE__, ##__VA_ARGS__);
+
+#define FRAME_RING_MAX_FRAMES  64
+
+typedef struct {
+  uint32_t offset;
+  uint32_t size;
+  uint32_t timeMSec;
+} FRAME_RING_ENTRY;
+
+/*** Internal Static Variables ***/
+static uint8_t          *sp_buff;
+static uint32_t         s_buffSize;
+static FRAME_RING_ENTRY s_frames[FRAME_RING_MAX_FRAMES];
+static uint32_t         s_oldest;     // index of s_frames
+static uint32_t         s_frameNum;
+static uint32_t         s_writePos;   // next to the newest frame
+static uint32_t         s_writeOffset;  // returned by the last frameRing_getWriteBuffer
+
+/* statistics */
+static uint32_t s_storedNum;    // committed frames
+static uint32_t s_evictedNum;   // frames overwritten by newer ones
+static uint32_t s_droppedNum;   // frames which could not be stored (e.g. larger than the space given)
+
+/*** Internal Function Declarations ***/
+
+/*** External Function Defines ***/
+RET frameRing_start(uint32_t size)
+{
+  sp_buff = pvPortMalloc(size);
+  if(sp_buff == 0) return RET_ERR_MEMORY;
+  s_buffSize   = size;
+  s_oldest     = 0;
+  s_frameNum   = 0;
+  s_writePos   = 0;
+  s_storedNum  = 0;
+  s_evictedNum = 0;
+  s_droppedNum = 0;
+  return RET_OK;
+}
+
+void frameRing_finish()
+{
+  vPortFree(sp_buff);
+  sp_buff = 0;
+  s_frameNum = 0;
+}
+
+/*
+ * get contiguous space of at least minSize bytes (or the whole buffer) for the next frame
+ * the oldest frames are evicted as needed. the actual size of the space is returned by p_size
+ */
+uint8_t *frameRing_getWriteBuffer(uint32_t minSize, uint32_t *p_size)
+{
+  if(minSize > s_buffSize) minSize = s_buffSize;
+
+  while(1) {
+    if(s_frameNum == 0) {
+      s_writeOffset = 0;
+      *p_size = s_buffSize;
+      break;
+    }
+    if(s_frameNum < FRAME_RING_MAX_FRAMES) {
+      uint32_t head = s_frames[s_oldest].offset;
+      if(s_writePos > head) {
+        /* frames are in [head, writePos). use the end, or wrap around to the top */
+        if(s_buffSize - s_writePos >= minSize) {
+          s_writeOffset = s_writePos;
+          *p_size = s_buffSize - s_writePos;
+          break;
+        }
+        if(head >= minSize) {
+          s_writeOffset = 0;
+          *p_size = head;
+          break;
+        }
+      } else {
+        /* frames are in [head, end) and [0, writePos) */
+        if(head - s_writePos >= minSize) {
+          s_writeOffset = s_writePos;
+          *p_size = head - s_writePos;
+          break;
+        }
+      }
+    }
+    /* evict the oldest */
+    s_oldest = (s_oldest + 1) % FRAME_RING_MAX_FRAMES;
+    s_frameNum--;
+    s_evictedNum++;
+  }
+
+  return sp_buff + s_writeOffset;
+}
+
+/* store the frame written to the space got by frameRing_getWriteBuffer. size = 0 means the frame was dropped */
+void frameRing_commit(uint32_t size, uint32_t timeMSec)
+{
+  if(size == 0) {
+    s_droppedNum++;
+    return;
+  }
+
+  FRAME_RING_ENTRY *p_entry = &s_frames[(s_oldest + s_frameNum) % FRAME_RING_MAX_FRAMES];
+  p_entry->offset   = s_writeOffset;
+  p_entry->size     = size;
+  p_entry->timeMSec = timeMSec;
+  s_frameNum++;
+  s_writePos = s_writeOffset + size;
+  s_storedNum++;
+}
+
+/* get the oldest frame and remove it from the ring. the data are valid until the next frameRing_getWriteBuffer */
+RET frameRing_pop(uint8_t **pp_data, uint32_t *p_size, uint32_t *p_timeMSec)
+{
+  if(s_frameNum == 0) return RET_NO_DATA;
+
+  FRAME_RING_ENTRY *p_entry = &s_frames[s_oldest];
+  *pp_data    = sp_buff + p_entry->offset;
+  *p_size     = p_entry->size;
+  *p_timeMSec = p_entry->timeMSec;
+  s_oldest = (s_oldest + 1) % FRAME_RING_MAX_FRAMES;
+  s_frameNum--;
+  return RET_OK;
+}
+
+uint32_t frameRing_getFrameNum()
+{
+  return s_frameNum;
+}
+
+void frameRing_showStats()
+{
+  uint32_t usedSize = 0;
+  for(uint32_t i = 0; i < s_frameNum; i++) {
+    usedSize += s_frames[(s_oldest + i) % FRAME_RING_MAX_FRAMES].size;
+  }
+  LOG("%d frames (%d/%d bytes) in ring. stored = %d, evicted = %d, dropped = %d\n",
+    s_frameNum, usedSize, s_buffSize, s_storedNum, s_evictedNum, s_droppedNum);
+}
+
+/*** Internal Function Defines ***/
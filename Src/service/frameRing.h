@@ -0,0 +1,19 @@
+/*
+ * frameRing.h
+ *
+ *  Created on: 2017/09/26
+ *      Author: take-iwiw
+ */
+
+#ifndef SERVICE_FRAMERING_H_
+#define SERVICE_FRAMERING_H_
+
+RET frameRing_start(uint32_t size);
+void frameRing_finish();
+uint8_t *frameRing_getWriteBuffer(uint32_t minSize, uint32_t *p_size);
+void frameRing_commit(uint32_t size, uint32_t timeMSec);
+RET frameRing_pop(uint8_t **pp_data, uint32_t *p_size, uint32_t *p_timeMSec);
+uint32_t frameRing_getFrameNum();
+void frameRing_showStats();
+
+#endif /* SERVICE_FRAMERING_H_ */
@@ -133,7 +133,7 @@ static void input_checkStatus()
   btn = HAL_GPIO_ReadPin(BTN_CAP_GPIO_Port, BTN_CAP_Pin);
   if( (btn != s_btnCap[1]) && (btn == s_btnCap[0]) ){
     s_btnCap[1] = s_btnCap[0];
-    if (btn == 0) input_notify(INPUT_TYPE_KEY_CAP, btn);
+    input_notify(INPUT_TYPE_KEY_CAP, btn);  // release (param = 1) is also notified for burst shooting
   }
   if(btn != s_btnCap[0]){
     s_btnCap[1] = s_btnCap[0];
@@ -0,0 +1,408 @@
+/*
+ * jpegFile.c
+ *
+ *  Created on: 2017/09/12
+ *      Author: take-iwiw
+ */
+#include <stdio.h>
+#include <string.h>
+#include "cmsis_os.h"
+#include "common.h"
+#include "ff.h"
+#include "jpeglib.h"
+#include "jerror.h"
+#include "perf.h"
+#include "fileWriter.h"
+#include "jpegFile.h"
+
+/*** Internal Const Values, Macros ***/
+#define JPEG_FILE_SECTOR_SIZE     _MIN_SS
+#define JPEG_FILE_OUTPUT_BUF_SIZE (JPEG_FILE_SECTOR_SIZE * 8)   // must be a multiple of sector size
+#define JPEG_FILE_INPUT_BUF_SIZE  (JPEG_FILE_SECTOR_SIZE * 2)   // must be a multiple of sector size
+
+/* destination manager which passes sector aligned blocks to f_write */
+/* f_write writes such blocks to the card directly without copying them to the sector buffer in FIL */
+typedef struct {
+  struct jpeg_destination_mgr pub;
+  FIL    *p_fil;
+  JOCTET *p_buffer;
+  size_t bufferSize;    // size of the current block (only the first block is shorter, to align the file position)
+} JPEG_FILE_DEST;
+
+/* destination manager which passes buffers of fileWriter to FileWriter task (the file is written asynchronously) */
+/* blocks are aligned to sectors of the logical file position (fileWriter_tell) in the same way as JPEG_FILE_DEST */
+typedef struct {
+  struct jpeg_destination_mgr pub;
+  JOCTET *p_buffer;     // buffer of fileWriter being filled (0 if not held)
+  size_t bufferSize;
+} JPEG_FILE_DEST_WRITER;
+
+/* destination manager which writes into a buffer of the caller. the image must fit in the buffer */
+typedef struct {
+  struct jpeg_destination_mgr pub;
+  JOCTET *p_buffer;
+  size_t bufferSize;
+  size_t dataSize;      // size of the image after term_destination
+} JPEG_FILE_DEST_MEM;
+
+/* source manager which reads exactly up to EOI from libjpeg's point of view */
+/* bytes read from the file but not consumed by the image are kept, and passed to the next image in the same file */
+typedef struct {
+  struct jpeg_source_mgr pub;
+  FIL    *p_fil;
+} JPEG_FILE_SRC;
+
+/*** Internal Static Variables ***/
+/* input buffer is kept beyond the lifetime of a decompress object */
+static JOCTET       s_srcBuffer[JPEG_FILE_INPUT_BUF_SIZE];
+static const JOCTET *sp_srcNextByte;  // leftover of the previous image
+static size_t       s_srcRemainSize;
+static uint32_t     s_srcReadSize;    // bytes passed to libjpeg for the current image
+static uint32_t     s_srcConsumedSize;
+
+/*** Internal Function Declarations ***/
+static void jpegFile_initDestination(j_compress_ptr cinfo);
+static boolean jpegFile_emptyOutputBuffer(j_compress_ptr cinfo);
+static void jpegFile_termDestination(j_compress_ptr cinfo);
+static void jpegFile_initDestinationWriter(j_compress_ptr cinfo);
+static boolean jpegFile_emptyOutputBufferWriter(j_compress_ptr cinfo);
+static void jpegFile_termDestinationWriter(j_compress_ptr cinfo);
+static void jpegFile_initDestinationMem(j_compress_ptr cinfo);
+static boolean jpegFile_emptyOutputBufferMem(j_compress_ptr cinfo);
+static void jpegFile_termDestinationMem(j_compress_ptr cinfo);
+static void jpegFile_initSource(j_decompress_ptr cinfo);
+static boolean jpegFile_fillInputBuffer(j_decompress_ptr cinfo);
+static void jpegFile_skipInputData(j_decompress_ptr cinfo, long numBytes);
+static void jpegFile_termSource(j_decompress_ptr cinfo);
+static boolean jpegFile_resyncToRestart(j_decompress_ptr cinfo, int desired);
+
+/*** External Function Defines ***/
+void jpegFile_setDest(j_compress_ptr cinfo, FIL *p_fil)
+{
+  JPEG_FILE_DEST *p_dest;
+
+  if(cinfo->dest == 0) {
+    /* allocated in the permanent pool so that the same compress object can be reused for multiple images */
+    cinfo->dest = (struct jpeg_destination_mgr *)(*cinfo->mem->alloc_small)((j_common_ptr)cinfo, JPOOL_PERMANENT, sizeof(JPEG_FILE_DEST));
+  } else if(cinfo->dest->init_destination != jpegFile_initDestination) {
+    ERREXIT(cinfo, JERR_BUFFER_SIZE);
+  }
+
+  p_dest = (JPEG_FILE_DEST *)cinfo->dest;
+  p_dest->pub.init_destination    = jpegFile_initDestination;
+  p_dest->pub.empty_output_buffer = jpegFile_emptyOutputBuffer;
+  p_dest->pub.term_destination    = jpegFile_termDestination;
+  p_dest->p_fil = p_fil;
+}
+
+/* output to the file started by fileWriter_start */
+void jpegFile_setDestWriter(j_compress_ptr cinfo)
+{
+  JPEG_FILE_DEST_WRITER *p_dest;
+
+  if(cinfo->dest == 0) {
+    cinfo->dest = (struct jpeg_destination_mgr *)(*cinfo->mem->alloc_small)((j_common_ptr)cinfo, JPOOL_PERMANENT, sizeof(JPEG_FILE_DEST_WRITER));
+    ((JPEG_FILE_DEST_WRITER *)cinfo->dest)->p_buffer = 0;
+  } else if(cinfo->dest->init_destination != jpegFile_initDestinationWriter) {
+    ERREXIT(cinfo, JERR_BUFFER_SIZE);
+  }
+
+  p_dest = (JPEG_FILE_DEST_WRITER *)cinfo->dest;
+  p_dest->pub.init_destination    = jpegFile_initDestinationWriter;
+  p_dest->pub.empty_output_buffer = jpegFile_emptyOutputBufferWriter;
+  p_dest->pub.term_destination    = jpegFile_termDestinationWriter;
+}
+
+/* output to p_buffer. the image is aborted by JERR_BUFFER_SIZE if it exceeds bufferSize */
+/* this can be called for each image to change the buffer */
+void jpegFile_setDestMem(j_compress_ptr cinfo, uint8_t *p_buffer, uint32_t bufferSize)
+{
+  JPEG_FILE_DEST_MEM *p_dest;
+
+  if(cinfo->dest == 0) {
+    cinfo->dest = (struct jpeg_destination_mgr *)(*cinfo->mem->alloc_small)((j_common_ptr)cinfo, JPOOL_PERMANENT, sizeof(JPEG_FILE_DEST_MEM));
+  } else if(cinfo->dest->init_destination != jpegFile_initDestinationMem) {
+    ERREXIT(cinfo, JERR_BUFFER_SIZE);
+  }
+
+  p_dest = (JPEG_FILE_DEST_MEM *)cinfo->dest;
+  p_dest->pub.init_destination    = jpegFile_initDestinationMem;
+  p_dest->pub.empty_output_buffer = jpegFile_emptyOutputBufferMem;
+  p_dest->pub.term_destination    = jpegFile_termDestinationMem;
+  p_dest->p_buffer   = p_buffer;
+  p_dest->bufferSize = bufferSize;
+  p_dest->dataSize   = 0;
+}
+
+/* size of the last image written by the destination set by jpegFile_setDestMem */
+uint32_t jpegFile_getDestMemSize(j_compress_ptr cinfo)
+{
+  return ((JPEG_FILE_DEST_MEM *)cinfo->dest)->dataSize;
+}
+
+/* discard bytes kept from the previous image. call this when the file is changed or moved by f_lseek */
+void jpegFile_resetSrc()
+{
+  sp_srcNextByte    = s_srcBuffer;
+  s_srcRemainSize   = 0;
+  s_srcConsumedSize = 0;
+}
+
+void jpegFile_setSrc(j_decompress_ptr cinfo, FIL *p_fil)
+{
+  JPEG_FILE_SRC *p_src;
+
+  if(cinfo->src == 0) {
+    cinfo->src = (struct jpeg_source_mgr *)(*cinfo->mem->alloc_small)((j_common_ptr)cinfo, JPOOL_PERMANENT, sizeof(JPEG_FILE_SRC));
+  } else if(cinfo->src->init_source != jpegFile_initSource) {
+    ERREXIT(cinfo, JERR_BUFFER_SIZE);
+  }
+
+  p_src = (JPEG_FILE_SRC *)cinfo->src;
+  p_src->pub.init_source       = jpegFile_initSource;
+  p_src->pub.fill_input_buffer = jpegFile_fillInputBuffer;
+  p_src->pub.skip_input_data   = jpegFile_skipInputData;
+  p_src->pub.resync_to_restart = jpeg_resync_to_restart;
+  p_src->pub.term_source       = jpegFile_termSource;
+  p_src->p_fil = p_fil;
+
+  /* start from the leftover of the previous image */
+  p_src->pub.next_input_byte = sp_srcNextByte;
+  p_src->pub.bytes_in_buffer = s_srcRemainSize;
+}
+
+/* the number of bytes (SOI to EOI) the last image consumed. valid after jpeg_finish_decompress */
+uint32_t jpegFile_getSrcConsumedSize()
+{
+  return s_srcConsumedSize;
+}
+
+/* true if all data in the file have been consumed */
+uint8_t jpegFile_isSrcEnd(FIL *p_fil)
+{
+  return (s_srcRemainSize == 0) && f_eof(p_fil);
+}
+
+/*
+ * skip restart intervals (DRI) which end above the row, so that the decoder starts from the top of the interval including the row
+ * call this after jpeg_read_header. the number of image rows skipped is returned (0 if the image has no restart marker)
+ * the decoder doesn't know rows are skipped. output_scanline = 0 means the skipped row
+ */
+RET jpegFile_skipRows(j_decompress_ptr cinfo, uint32_t row, uint32_t *p_skippedRows)
+{
+  struct jpeg_source_mgr *p_src = cinfo->src;
+  uint32_t mcuWidth, mcuHeight;
+
+  *p_skippedRows = 0;
+  if( (cinfo->restart_interval == 0) || cinfo->progressive_mode ) return RET_OK;
+
+  if(cinfo->comps_in_scan == 1) {
+    mcuWidth  = cinfo->cur_comp_info[0]->width_in_blocks;
+    mcuHeight = cinfo->block_size;
+  } else {
+    mcuWidth  = (cinfo->image_width + cinfo->max_h_samp_factor * cinfo->block_size - 1) / (cinfo->max_h_samp_factor * cinfo->block_size);
+    mcuHeight = cinfo->max_v_samp_factor * cinfo->block_size;
+  }
+  if(cinfo->restart_interval % mcuWidth != 0) return RET_OK;  // an interval doesn't start at the left edge
+  uint32_t intervalRows = (cinfo->restart_interval / mcuWidth) * mcuHeight;
+  uint32_t intervalNum  = row / intervalRows;
+
+  /* look for the restart marker before the interval in entropy-coded data (0xFF in data is followed by 0x00) */
+  for(uint32_t i = 0; i < intervalNum; ) {
+    if(p_src->bytes_in_buffer == 0) (*p_src->fill_input_buffer)(cinfo);
+    const JOCTET *p_ff = memchr(p_src->next_input_byte, 0xFF, p_src->bytes_in_buffer);
+    if(p_ff == 0) {
+      p_src->next_input_byte += p_src->bytes_in_buffer;
+      p_src->bytes_in_buffer = 0;
+      continue;
+    }
+    p_src->bytes_in_buffer -= p_ff + 1 - p_src->next_input_byte;
+    p_src->next_input_byte  = p_ff + 1;
+
+    /* marker code (may be in the next buffer, and may be preceded by fill bytes) */
+    JOCTET code;
+    do {
+      if(p_src->bytes_in_buffer == 0) (*p_src->fill_input_buffer)(cinfo);
+      code = *p_src->next_input_byte++;
+      p_src->bytes_in_buffer--;
+    } while(code == 0xFF);
+    if( (code >= JPEG_RST0) && (code <= JPEG_RST0 + 7) ) {
+      i++;
+    } else if(code != 0x00) {
+      return RET_ERR;   // e.g. EOI (fewer intervals than expected)
+    }
+  }
+
+  /* the decoder expects RST0 at the end of the first interval */
+  p_src->resync_to_restart = jpegFile_resyncToRestart;
+  *p_skippedRows = intervalNum * intervalRows;
+  return RET_OK;
+}
+
+/*** Internal Function Defines ***/
+static void jpegFile_initDestination(j_compress_ptr cinfo)
+{
+  JPEG_FILE_DEST *p_dest = (JPEG_FILE_DEST *)cinfo->dest;
+
+  p_dest->p_buffer = (JOCTET *)(*cinfo->mem->alloc_small)((j_common_ptr)cinfo, JPOOL_IMAGE, JPEG_FILE_OUTPUT_BUF_SIZE);
+
+  /* the first block ends at a sector boundary, so that the following blocks start at sector boundaries */
+  p_dest->bufferSize = JPEG_FILE_OUTPUT_BUF_SIZE - (f_tell(p_dest->p_fil) % JPEG_FILE_SECTOR_SIZE);
+  p_dest->pub.next_output_byte = p_dest->p_buffer;
+  p_dest->pub.free_in_buffer   = p_dest->bufferSize;
+}
+
+static boolean jpegFile_emptyOutputBuffer(j_compress_ptr cinfo)
+{
+  JPEG_FILE_DEST *p_dest = (JPEG_FILE_DEST *)cinfo->dest;
+  UINT num;
+
+  PERF_START(perfStart);
+  FRESULT ret = f_write(p_dest->p_fil, p_dest->p_buffer, p_dest->bufferSize, &num);
+  PERF_STOP(PERF_WRITE, perfStart);
+  if( (ret != FR_OK) || (num != p_dest->bufferSize) ) {
+    ERREXIT(cinfo, JERR_FILE_WRITE);  // e.g. disk full
+  }
+
+  p_dest->bufferSize = JPEG_FILE_OUTPUT_BUF_SIZE;
+  p_dest->pub.next_output_byte = p_dest->p_buffer;
+  p_dest->pub.free_in_buffer   = p_dest->bufferSize;
+
+  return TRUE;
+}
+
+static void jpegFile_termDestination(j_compress_ptr cinfo)
+{
+  JPEG_FILE_DEST *p_dest = (JPEG_FILE_DEST *)cinfo->dest;
+  UINT num;
+  size_t size = p_dest->bufferSize - p_dest->pub.free_in_buffer;
+
+  if(size > 0) {
+    PERF_START(perfStart);
+    FRESULT ret = f_write(p_dest->p_fil, p_dest->p_buffer, size, &num);
+    PERF_STOP(PERF_WRITE, perfStart);
+    if( (ret != FR_OK) || (num != size) ) {
+      ERREXIT(cinfo, JERR_FILE_WRITE);
+    }
+  }
+}
+
+static void jpegFile_initDestinationWriter(j_compress_ptr cinfo)
+{
+  JPEG_FILE_DEST_WRITER *p_dest = (JPEG_FILE_DEST_WRITER *)cinfo->dest;
+
+  /* the previous image was aborted without term_destination */
+  if(p_dest->p_buffer != 0) fileWriter_write(p_dest->p_buffer, 0);
+
+  p_dest->p_buffer   = fileWriter_getBuffer();
+  p_dest->bufferSize = fileWriter_getBufferSize() - (fileWriter_tell() % JPEG_FILE_SECTOR_SIZE);
+  p_dest->pub.next_output_byte = p_dest->p_buffer;
+  p_dest->pub.free_in_buffer   = p_dest->bufferSize;
+}
+
+static boolean jpegFile_emptyOutputBufferWriter(j_compress_ptr cinfo)
+{
+  JPEG_FILE_DEST_WRITER *p_dest = (JPEG_FILE_DEST_WRITER *)cinfo->dest;
+
+  RET ret = fileWriter_write(p_dest->p_buffer, p_dest->bufferSize);
+  p_dest->p_buffer = 0;
+  if(ret != RET_OK) ERREXIT(cinfo, JERR_FILE_WRITE);
+
+  /* blocked here only when all buffers are waiting for SD card */
+  p_dest->p_buffer   = fileWriter_getBuffer();
+  p_dest->bufferSize = fileWriter_getBufferSize();
+  p_dest->pub.next_output_byte = p_dest->p_buffer;
+  p_dest->pub.free_in_buffer   = p_dest->bufferSize;
+
+  return TRUE;
+}
+
+static void jpegFile_termDestinationWriter(j_compress_ptr cinfo)
+{
+  JPEG_FILE_DEST_WRITER *p_dest = (JPEG_FILE_DEST_WRITER *)cinfo->dest;
+  size_t size = p_dest->bufferSize - p_dest->pub.free_in_buffer;
+
+  RET ret = fileWriter_write(p_dest->p_buffer, size);   // size = 0 just returns the buffer
+  p_dest->p_buffer = 0;
+  if(ret != RET_OK) ERREXIT(cinfo, JERR_FILE_WRITE);
+}
+
+static void jpegFile_initDestinationMem(j_compress_ptr cinfo)
+{
+  JPEG_FILE_DEST_MEM *p_dest = (JPEG_FILE_DEST_MEM *)cinfo->dest;
+  p_dest->dataSize = 0;
+  p_dest->pub.next_output_byte = p_dest->p_buffer;
+  p_dest->pub.free_in_buffer   = p_dest->bufferSize;
+}
+
+static boolean jpegFile_emptyOutputBufferMem(j_compress_ptr cinfo)
+{
+  ERREXIT(cinfo, JERR_BUFFER_SIZE);   // the caller should use lower quality or a bigger buffer
+  return FALSE;
+}
+
+static void jpegFile_termDestinationMem(j_compress_ptr cinfo)
+{
+  JPEG_FILE_DEST_MEM *p_dest = (JPEG_FILE_DEST_MEM *)cinfo->dest;
+  p_dest->dataSize = p_dest->bufferSize - p_dest->pub.free_in_buffer;
+}
+
+static void jpegFile_initSource(j_decompress_ptr cinfo)
+{
+  s_srcReadSize = cinfo->src->bytes_in_buffer;
+}
+
+static boolean jpegFile_fillInputBuffer(j_decompress_ptr cinfo)
+{
+  JPEG_FILE_SRC *p_src = (JPEG_FILE_SRC *)cinfo->src;
+  UINT num;
+
+  /* read up to a sector boundary, so that f_read can read sectors directly into the buffer from the next time */
+  UINT size = JPEG_FILE_INPUT_BUF_SIZE - (f_tell(p_src->p_fil) % JPEG_FILE_SECTOR_SIZE);
+  if( (f_read(p_src->p_fil, s_srcBuffer, size, &num) != FR_OK) || (num == 0) ) {
+    if(s_srcReadSize == 0) ERREXIT(cinfo, JERR_INPUT_EMPTY);
+    WARNMS(cinfo, JWRN_JPEG_EOF);
+    /* insert a fake EOI marker */
+    s_srcBuffer[0] = (JOCTET) 0xFF;
+    s_srcBuffer[1] = (JOCTET) JPEG_EOI;
+    num = 2;
+  }
+
+  s_srcReadSize += num;
+  p_src->pub.next_input_byte = s_srcBuffer;
+  p_src->pub.bytes_in_buffer = num;
+
+  return TRUE;
+}
+
+static void jpegFile_skipInputData(j_decompress_ptr cinfo, long numBytes)
+{
+  struct jpeg_source_mgr *p_src = cinfo->src;
+
+  if(numBytes > 0) {
+    while(numBytes > (long)p_src->bytes_in_buffer) {
+      numBytes -= (long)p_src->bytes_in_buffer;
+      (void)(*p_src->fill_input_buffer)(cinfo);
+    }
+    p_src->next_input_byte += (size_t)numBytes;
+    p_src->bytes_in_buffer -= (size_t)numBytes;
+  }
+}
+
+/* restart markers are numbered from the top of image, so the number doesn't match after jpegFile_skipRows. accept any restart marker */
+static boolean jpegFile_resyncToRestart(j_decompress_ptr cinfo, int desired)
+{
+  if( (cinfo->unread_marker >= JPEG_RST0) && (cinfo->unread_marker <= JPEG_RST0 + 7) ) {
+    cinfo->unread_marker = 0;
+    return TRUE;
+  }
+  return jpeg_resync_to_restart(cinfo, desired);
+}
+
+static void jpegFile_termSource(j_decompress_ptr cinfo)
+{
+  /* keep bytes after EOI for the next image */
+  sp_srcNextByte    = cinfo->src->next_input_byte;
+  s_srcRemainSize   = cinfo->src->bytes_in_buffer;
+  s_srcConsumedSize = s_srcReadSize - s_srcRemainSize;
+}
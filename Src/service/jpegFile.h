@@ -0,0 +1,21 @@
+/*
+ * jpegFile.h
+ *
+ *  Created on: 2017/09/12
+ *      Author: take-iwiw
+ */
+
+#ifndef SERVICE_JPEGFILE_H_
+#define SERVICE_JPEGFILE_H_
+
+void jpegFile_setDest(j_compress_ptr cinfo, FIL *p_fil);
+void jpegFile_setDestWriter(j_compress_ptr cinfo);
+void jpegFile_setDestMem(j_compress_ptr cinfo, uint8_t *p_buffer, uint32_t bufferSize);
+uint32_t jpegFile_getDestMemSize(j_compress_ptr cinfo);
+void jpegFile_resetSrc();
+void jpegFile_setSrc(j_decompress_ptr cinfo, FIL *p_fil);
+uint32_t jpegFile_getSrcConsumedSize();
+uint8_t jpegFile_isSrcEnd(FIL *p_fil);
+RET jpegFile_skipRows(j_decompress_ptr cinfo, uint32_t row, uint32_t *p_skippedRows);
+
+#endif /* SERVICE_JPEGFILE_H_ */
@@ -0,0 +1,105 @@
+/*
+ * jpegMem.c
+ *
+ *  Created on: 2017/09/17
+ *      Author: take-iwiw
+ */
+#include <stdint.h>
+#include <stddef.h>
+#include "cmsis_os.h"
+#include "applicationSettings.h"
+#include "jpegMem.h"
+
+/* memory backend of libjpeg (JMALLOC/JFREE in jdata_conf.h) */
+/* libjpeg allocates a few big pool blocks and frees them all at jpeg_finish_xxx / jpeg_destroy_xxx, */
+/*  so a stack (bump allocator) is enough: alloc and free are O(1) and never fragment the FreeRTOS heap */
+/* a freed block is reclaimed when every block above it has been freed (libjpeg frees newer blocks first in most cases) */
+/* this is not thread safe. only one task may use libjpeg at a time */
+
+/*** Internal Const Values, Macros ***/
+#define JPEG_MEM_ALIGN         8   // same as ALIGN_TYPE (double) in jmemmgr.c
+#define JPEG_MEM_ROUND_UP(x)   (((x) + (JPEG_MEM_ALIGN - 1)) & ~(JPEG_MEM_ALIGN - 1))
+
+#if JPEG_MEM_IN_CCMRAM
+#define JPEG_MEM_REGION_ATTR   __attribute__((section(".ccmram_noinit"), aligned(JPEG_MEM_ALIGN)))   // not in the flash image. contents are undefined at startup
+#else
+#define JPEG_MEM_REGION_ATTR   __attribute__((aligned(JPEG_MEM_ALIGN)))
+#endif
+
+typedef union JPEG_MEM_HEADER_ {
+  struct {
+    union JPEG_MEM_HEADER_ *p_prev;   // block below this block
+    uint32_t isFree;
+  } hdr;
+  uint8_t dummy[JPEG_MEM_ROUND_UP(sizeof(void*) + sizeof(uint32_t))];  // keep the following data aligned
+} JPEG_MEM_HEADER;
+
+/*** Internal Static Variables ***/
+static uint8_t         s_region[JPEG_MEM_SIZE] JPEG_MEM_REGION_ATTR;
+static uint8_t         *sp_top = s_region;   // next free address
+static JPEG_MEM_HEADER *sp_last = 0;         // the top-most block
+static uint32_t        s_peakSize = 0;
+static uint32_t        s_fallbackCount = 0;
+
+/*** Internal Function Declarations ***/
+
+/*** External Function Defines ***/
+void *jpegMem_alloc(size_t size)
+{
+  size_t blockSize = sizeof(JPEG_MEM_HEADER) + JPEG_MEM_ROUND_UP(size);
+
+  if(blockSize > (size_t)(s_region + JPEG_MEM_SIZE - sp_top)) {
+    /* region is too small. JPEG_MEM_SIZE should be set to the peak size */
+    s_fallbackCount++;
+    return pvPortMalloc(size);
+  }
+
+  JPEG_MEM_HEADER *p_header = (JPEG_MEM_HEADER*)sp_top;
+  p_header->hdr.p_prev = sp_last;
+  p_header->hdr.isFree = 0;
+  sp_last = p_header;
+  sp_top += blockSize;
+
+  if(sp_top - s_region > s_peakSize) s_peakSize = sp_top - s_region;
+
+  return p_header + 1;
+}
+
+void jpegMem_free(void *p)
+{
+  if(p == 0) return;
+
+  if( ((uint8_t*)p < s_region) || ((uint8_t*)p >= s_region + JPEG_MEM_SIZE) ) {
+    vPortFree(p);   // allocated by fallback
+    return;
+  }
+
+  ((JPEG_MEM_HEADER*)p - 1)->hdr.isFree = 1;
+
+  /* pop free blocks from the top. the region becomes empty when libjpeg frees everything */
+  while( (sp_last != 0) && sp_last->hdr.isFree ) {
+    sp_top  = (uint8_t*)sp_last;
+    sp_last = sp_last->hdr.p_prev;
+  }
+}
+
+uint32_t jpegMem_getUsedSize()
+{
+  return sp_top - s_region;
+}
+
+uint32_t jpegMem_getPeakSize()
+{
+  return s_peakSize;
+}
+
+uint32_t jpegMem_getFallbackCount()
+{
+  return s_fallbackCount;
+}
+
+void jpegMem_resetPeak()
+{
+  s_peakSize = jpegMem_getUsedSize();
+  s_fallbackCount = 0;
+}
@@ -0,0 +1,18 @@
+/*
+ * jpegMem.h
+ *
+ *  Created on: 2017/09/17
+ *      Author: take-iwiw
+ */
+
+#ifndef SERVICE_JPEGMEM_H_
+#define SERVICE_JPEGMEM_H_
+
+void *jpegMem_alloc(size_t size);
+void jpegMem_free(void *p);
+uint32_t jpegMem_getUsedSize();
+uint32_t jpegMem_getPeakSize();
+uint32_t jpegMem_getFallbackCount();
+void jpegMem_resetPeak();
+
+#endif /* SERVICE_JPEGMEM_H_ */
@@ -0,0 +1,77 @@
+/*
+ * jpegTable.c
+ *
+ *  Created on: 2017/09/16
+ *      Author: take-iwiw
+ */
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include "ff.h"
+#include "jpeglib.h"
+#include "jpegTable.h"
+
+/*** Internal Const Values, Macros ***/
+/* same calculation as jpeg_quality_scaling() and jpeg_add_quant_table(force_baseline = TRUE) in jcparam.c */
+/* tables are calculated by the compiler, so that they are placed in flash and nothing is calculated at run time */
+#define JPEG_TABLE_SCALE(q)      (((q) < 50) ? (5000 / (q)) : (200 - (q) * 2))
+#define JPEG_TABLE_CLAMP(x)      (((x) <= 0) ? 1 : (((x) > 255) ? 255 : (x)))
+#define JPEG_TABLE_Q(basic, q)   JPEG_TABLE_CLAMP(((basic) * JPEG_TABLE_SCALE(q) + 50) / 100)
+
+#define JPEG_TABLE_Q8(q, a, b, c, d, e, f, g, h) \
+  JPEG_TABLE_Q(a, q), JPEG_TABLE_Q(b, q), JPEG_TABLE_Q(c, q), JPEG_TABLE_Q(d, q), \
+  JPEG_TABLE_Q(e, q), JPEG_TABLE_Q(f, q), JPEG_TABLE_Q(g, q), JPEG_TABLE_Q(h, q)
+
+/* standard tables (cf. JPEG standard section K.1) in natural order */
+#define JPEG_TABLE_LUMINANCE(q) { \
+  JPEG_TABLE_Q8(q, 16,  11,  10,  16,  24,  40,  51,  61), \
+  JPEG_TABLE_Q8(q, 12,  12,  14,  19,  26,  58,  60,  55), \
+  JPEG_TABLE_Q8(q, 14,  13,  16,  24,  40,  57,  69,  56), \
+  JPEG_TABLE_Q8(q, 14,  17,  22,  29,  51,  87,  80,  62), \
+  JPEG_TABLE_Q8(q, 18,  22,  37,  56,  68, 109, 103,  77), \
+  JPEG_TABLE_Q8(q, 24,  35,  55,  64,  81, 104, 113,  92), \
+  JPEG_TABLE_Q8(q, 49,  64,  78,  87, 103, 121, 120, 101), \
+  JPEG_TABLE_Q8(q, 72,  92,  95,  98, 112, 100, 103,  99), \
+}
+#define JPEG_TABLE_CHROMINANCE(q) { \
+  JPEG_TABLE_Q8(q, 17,  18,  24,  47,  99,  99,  99,  99), \
+  JPEG_TABLE_Q8(q, 18,  21,  26,  66,  99,  99,  99,  99), \
+  JPEG_TABLE_Q8(q, 24,  26,  56,  99,  99,  99,  99,  99), \
+  JPEG_TABLE_Q8(q, 47,  66,  99,  99,  99,  99,  99,  99), \
+  JPEG_TABLE_Q8(q, 99,  99,  99,  99,  99,  99,  99,  99), \
+  JPEG_TABLE_Q8(q, 99,  99,  99,  99,  99,  99,  99,  99), \
+  JPEG_TABLE_Q8(q, 99,  99,  99,  99,  99,  99,  99,  99), \
+  JPEG_TABLE_Q8(q, 99,  99,  99,  99,  99,  99,  99,  99), \
+}
+#define JPEG_TABLE_ENTRY(q) { JPEG_TABLE_LUMINANCE(q), JPEG_TABLE_CHROMINANCE(q) }
+
+/*** Internal Static Variables ***/
+static const UINT16 s_quantTable[JPEG_TABLE_LEVEL_NUM][2][DCTSIZE2] = {
+  JPEG_TABLE_ENTRY(10), JPEG_TABLE_ENTRY(20), JPEG_TABLE_ENTRY(30), JPEG_TABLE_ENTRY(40), JPEG_TABLE_ENTRY(50),
+  JPEG_TABLE_ENTRY(60), JPEG_TABLE_ENTRY(70), JPEG_TABLE_ENTRY(80), JPEG_TABLE_ENTRY(90), JPEG_TABLE_ENTRY(100),
+};
+
+/*** Internal Function Declarations ***/
+
+/*** External Function Defines ***/
+uint32_t jpegTable_getQuality(uint32_t level)
+{
+  if(level >= JPEG_TABLE_LEVEL_NUM) level = JPEG_TABLE_LEVEL_NUM - 1;
+  return (level + 1) * JPEG_TABLE_QUALITY_STEP;
+}
+
+/* replacement of jpeg_set_quality(cinfo, jpegTable_getQuality(level), TRUE). call this after jpeg_set_defaults */
+void jpegTable_setQuality(j_compress_ptr cinfo, uint32_t level)
+{
+  if(level >= JPEG_TABLE_LEVEL_NUM) level = JPEG_TABLE_LEVEL_NUM - 1;
+
+  for(uint32_t i = 0; i < 2; i++) {
+    JQUANT_TBL *p_tbl = cinfo->quant_tbl_ptrs[i];
+    if(p_tbl == 0) {
+      p_tbl = jpeg_alloc_quant_table((j_common_ptr)cinfo);
+      cinfo->quant_tbl_ptrs[i] = p_tbl;
+    }
+    memcpy(p_tbl->quantval, s_quantTable[level][i], sizeof(p_tbl->quantval));
+    p_tbl->sent_table = FALSE;
+  }
+}
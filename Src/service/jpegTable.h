@@ -0,0 +1,19 @@
+/*
+ * jpegTable.h
+ *
+ *  Created on: 2017/09/16
+ *      Author: take-iwiw
+ */
+
+#ifndef SERVICE_JPEGTABLE_H_
+#define SERVICE_JPEGTABLE_H_
+
+/* quality is selected from 10, 20, ..., 100 (level 0 - 9) */
+#define JPEG_TABLE_QUALITY_STEP  10
+#define JPEG_TABLE_LEVEL_NUM     10
+#define JPEG_TABLE_LEVEL(quality) ((quality) / JPEG_TABLE_QUALITY_STEP - 1)
+
+uint32_t jpegTable_getQuality(uint32_t level);
+void jpegTable_setQuality(j_compress_ptr cinfo, uint32_t level);
+
+#endif /* SERVICE_JPEGTABLE_H_ */
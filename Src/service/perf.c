@@ -0,0 +1,101 @@
+/*
+ * perf.c
+ *
+ *  Created on: 2017/09/22
+ *      Author: take-iwiw
+ */
+#include <stdio.h>
+#include <stdint.h>
+#include "perf.h"
+#if defined(__arm__)
+#include "stm32f4xx.h"
+#else
+#include <time.h>
+#endif
+
+/* time spent in each encode stage, accumulated until perf_reset ("perf" command of debug monitor) */
+/* the counter is DWT CYCCNT (CPU clock) on target, and nanoseconds on PC */
+/* time is wall clock, so it includes preemption by other tasks and interrupts */
+/* each stage is updated by only one task at a time (FileWriter for movie, LiveviewCtrl otherwise), so no lock is used */
+/* (SD stages are updated by the task which holds the FatFs volume) */
+
+/*** Internal Const Values, Macros ***/
+#if defined(__arm__)
+#define PERF_COUNT_PER_USEC  (SystemCoreClock / 1000000)
+#else
+#define PERF_COUNT_PER_USEC  1000
+#endif
+
+typedef struct {
+  uint32_t num;
+  uint64_t total;
+  uint32_t max;
+} PERF_ENTRY;
+
+/*** Internal Static Variables ***/
+static PERF_ENTRY s_entries[PERF_STAGE_NUM];
+static const char * const s_stageNames[PERF_STAGE_NUM] = {
+  "capture", "convert", "dct", "huffman", "display", "write", "close", "sdpoll", "sddma", "frame",
+};
+
+/*** Internal Function Declarations ***/
+
+/*** External Function Defines ***/
+void perf_init()
+{
+#if defined(__arm__)
+  CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+  DWT->CYCCNT = 0;
+  DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+#endif
+  perf_reset();
+}
+
+uint32_t perf_getCount()
+{
+#if defined(__arm__)
+  return DWT->CYCCNT;
+#else
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint32_t)((uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec);
+#endif
+}
+
+void perf_add(PERF_STAGE stage, uint32_t startCount)
+{
+  uint32_t count = perf_getCount() - startCount;  // wrap around is fine as long as a stage is shorter than 2^32 counts (25sec at 168MHz)
+  PERF_ENTRY *p_entry = &s_entries[stage];
+  p_entry->num++;
+  p_entry->total += count;
+  if(count > p_entry->max) p_entry->max = count;
+}
+
+void perf_show()
+{
+  uint32_t countPerUsec = PERF_COUNT_PER_USEC;
+  uint64_t frameTotal = s_entries[PERF_FRAME].total;
+  uint32_t frameNum = s_entries[PERF_FRAME].num;
+
+  printf("stage      num  total[us]  /frame[us]  max[us]    %%\n");
+  for(uint32_t i = 0; i < PERF_STAGE_NUM; i++) {
+    PERF_ENTRY *p_entry = &s_entries[i];
+    /* newlib-nano printf doesn't support long long */
+    uint32_t totalUsec = (uint32_t)(p_entry->total / countPerUsec);
+    uint32_t frameUsec = (frameNum > 0) ? totalUsec / frameNum : 0;
+    uint32_t maxUsec   = p_entry->max / countPerUsec;
+    uint32_t percent   = (frameTotal > 0) ? (uint32_t)(p_entry->total * 100 / frameTotal) : 0;
+    printf("%-8s %5d %10d  %10d %8d  %3d\n", s_stageNames[i], p_entry->num, totalUsec, frameUsec, maxUsec, percent);
+  }
+}
+
+void perf_reset()
+{
+  for(uint32_t i = 0; i < PERF_STAGE_NUM; i++) {
+    s_entries[i].num   = 0;
+    s_entries[i].total = 0;
+    s_entries[i].max   = 0;
+  }
+}
+
+/*** Internal Function Defines ***/
@@ -0,0 +1,147 @@
+/*
+ * rateCtrl.c
+ *
+ *  Created on: 2017/09/18
+ *      Author: take-iwiw
+ */
+#include <stdio.h>
+#include <stdint.h>
+#include "applicationSettings.h"
+#include "rateCtrl.h"
+
+/* constant bitrate control for motion jpeg */
+/* quality level (see jpegTable.h) of the next frame is decided from the size and the encode + write time of each frame */
+/* this module has no dependency on hardware, so it can be run on PC with synthetic frame sizes */
+
+/*** Internal Const Values, Macros ***/
+#define LOG(str, ...) printf("[RATE_CTRL:%d] " str, __LINE__, ##__VA_ARGS__);
+#define LOG_E(str, ...) printf("[RATE_CTRL_ERR:%d] " str, __LINE__, ##__VA_ARGS__);
+
+#define RATE_CTRL_BUSY_PERCENT  70   // encode + write should finish within this ratio of frame time (the rest is for capture)
+#define RATE_CTRL_BUCKET_MAX    4    // accumulated excess bytes are limited to this number of frames
+#define RATE_CTRL_BUCKET_MIN    2    // saved bytes are limited to this number of frames (so that a still scene cannot save too much)
+#define RATE_CTRL_RAISE_FRAMES  3    // quality is raised after this number of consecutive small frames
+#define RATE_CTRL_TIME_SHIFT    3    // weight of the latest frame in the average time is 1/8
+
+/*** Internal Static Variables ***/
+static uint32_t s_frameBudget;    // target bytes per frame
+static uint32_t s_busyBudget;     // target encode + write msec per frame
+static uint32_t s_minLevel;
+static uint32_t s_maxLevel;
+static uint32_t s_level;
+static int32_t  s_bucket;         // bytes written over the budget so far (negative means saved)
+static uint32_t s_smallCount;     // consecutive frames which have room for higher quality
+static uint32_t s_busyAvg;        // average encode + write msec (fixed point, RATE_CTRL_TIME_SHIFT bits)
+
+/* statistics */
+static uint32_t s_frameNum;
+static uint32_t s_totalSize;
+static uint32_t s_totalBusyMSec;
+static uint32_t s_maxSize;
+static uint32_t s_maxBusyMSec;
+static uint32_t s_overTimeNum;
+static uint32_t s_lowestLevel;
+static uint32_t s_highestLevel;
+
+/*** Internal Function Declarations ***/
+
+/*** External Function Defines ***/
+void rateCtrl_init(uint32_t targetBytesPerSec, uint32_t frameMSec, uint32_t minLevel, uint32_t maxLevel, uint32_t startLevel)
+{
+  s_frameBudget = targetBytesPerSec * frameMSec / 1000;
+  s_busyBudget  = frameMSec * RATE_CTRL_BUSY_PERCENT / 100;
+  s_minLevel = minLevel;
+  s_maxLevel = (maxLevel < minLevel) ? minLevel : maxLevel;
+  s_level    = startLevel;
+  if(s_level < s_minLevel) s_level = s_minLevel;
+  if(s_level > s_maxLevel) s_level = s_maxLevel;
+  s_bucket     = 0;
+  s_smallCount = 0;
+  s_busyAvg    = 0;
+
+  s_frameNum      = 0;
+  s_totalSize     = 0;
+  s_totalBusyMSec = 0;
+  s_maxSize       = 0;
+  s_maxBusyMSec   = 0;
+  s_overTimeNum   = 0;
+  s_lowestLevel   = s_level;
+  s_highestLevel  = s_level;
+}
+
+/* call this after each frame is written. returns the quality level for the next frame */
+uint32_t rateCtrl_update(uint32_t frameSize, uint32_t busyMSec)
+{
+#if RATE_CTRL_LOG_FRAMES
+  uint32_t prevLevel = s_level;
+#endif
+  int32_t  budget = (int32_t)s_frameBudget;
+  uint32_t down = 0;
+  uint32_t busyAvgMSec;
+
+  /*** statistics ***/
+  s_frameNum++;
+  s_totalSize     += frameSize;
+  s_totalBusyMSec += busyMSec;
+  if(frameSize > s_maxSize) s_maxSize = frameSize;
+  if(busyMSec > s_maxBusyMSec) s_maxBusyMSec = busyMSec;
+  if(busyMSec > s_busyBudget) s_overTimeNum++;
+
+  /*** leaky bucket ***/
+  s_bucket += (int32_t)frameSize - budget;
+  if(s_bucket > budget * RATE_CTRL_BUCKET_MAX) s_bucket = budget * RATE_CTRL_BUCKET_MAX;
+  if(s_bucket < -budget * RATE_CTRL_BUCKET_MIN) s_bucket = -budget * RATE_CTRL_BUCKET_MIN;
+
+  /*** average time ***/
+  /* a single SD card stall should not lower quality, so each sample is limited to 1.5 times of the budget */
+  uint32_t sample = (busyMSec > s_busyBudget * 3 / 2) ? s_busyBudget * 3 / 2 : busyMSec;
+  if(s_frameNum == 1) {
+    s_busyAvg = sample << RATE_CTRL_TIME_SHIFT;
+  } else {
+    s_busyAvg += sample - (s_busyAvg >> RATE_CTRL_TIME_SHIFT);
+  }
+  busyAvgMSec = s_busyAvg >> RATE_CTRL_TIME_SHIFT;
+
+  /*** decide next quality ***/
+  if(busyAvgMSec > s_busyBudget) {
+    /* fps cannot be kept. a smaller frame takes less time to encode (entropy coding) and to write */
+    down = 1;
+  } else if( (s_bucket > 0) && ((int32_t)frameSize > budget + budget / 8) ) {
+    down = ((int32_t)frameSize > budget * 2) ? 2 : 1;
+  }
+
+  if(down > 0) {
+    s_smallCount = 0;
+    s_level = (s_level >= s_minLevel + down) ? s_level - down : s_minLevel;
+  } else if( (s_bucket <= 0) && ((int32_t)frameSize < budget - budget / 4) && (busyAvgMSec < s_busyBudget * 3 / 4) ) {
+    /* raise quality carefully, because one level up makes a frame about 10-30% bigger */
+    if(++s_smallCount >= RATE_CTRL_RAISE_FRAMES) {
+      s_smallCount = 0;
+      if(s_level < s_maxLevel) s_level++;
+    }
+  } else {
+    s_smallCount = 0;
+  }
+  if(s_level < s_lowestLevel) s_lowestLevel = s_level;
+  if(s_level > s_highestLevel) s_highestLevel = s_level;
+
+#if RATE_CTRL_LOG_FRAMES
+  LOG("frame %d: size = %d, time = %d (avg %d), level = %d -> %d, bucket = %d\n", s_frameNum, frameSize, busyMSec, busyAvgMSec, prevLevel, s_level, s_bucket);
+#endif
+
+  return s_level;
+}
+
+uint32_t rateCtrl_getLevel()
+{
+  return s_level;
+}
+
+void rateCtrl_showStats()
+{
+  if(s_frameNum == 0) return;
+  LOG("frames = %d, target = %d bytes/frame, %d msec/frame\n", s_frameNum, s_frameBudget, s_busyBudget);
+  LOG("size: avg = %d, max = %d. time: avg = %d, max = %d, over = %d\n",
+    s_totalSize / s_frameNum, s_maxSize, s_totalBusyMSec / s_frameNum, s_maxBusyMSec, s_overTimeNum);
+  LOG("level: last = %d, lowest = %d, highest = %d\n", s_level, s_lowestLevel, s_highestLevel);
+}
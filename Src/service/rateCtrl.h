@@ -0,0 +1,16 @@
+/*
+ * rateCtrl.h
+ *
+ *  Created on: 2017/09/18
+ *      Author: take-iwiw
+ */
+
+#ifndef SERVICE_RATECTRL_H_
+#define SERVICE_RATECTRL_H_
+
+void rateCtrl_init(uint32_t targetBytesPerSec, uint32_t frameMSec, uint32_t minLevel, uint32_t maxLevel, uint32_t startLevel);
+uint32_t rateCtrl_update(uint32_t frameSize, uint32_t busyMSec);
+uint32_t rateCtrl_getLevel();
+void rateCtrl_showStats();
+
+#endif /* SERVICE_RATECTRL_H_ */
@@ -0,0 +1,241 @@
+/*
+ * ycbcr.c
+ *
+ *  Created on: 2017/09/14
+ *      Author: take-iwiw
+ */
+#include <stdint.h>
+#if defined(__ARM_FEATURE_DSP) && (__ARM_FEATURE_DSP == 1)
+#include "stm32f4xx.h"    // SIMD intrinsics of CMSIS
+#define YCBCR_USE_SIMD 1
+#else
+#define YCBCR_USE_SIMD 0
+#endif
+#include "ycbcr.h"
+
+/*** Internal Const Values, Macros ***/
+/* JFIF YCbCr coefficients in 16-bit fixed point (same values as jccolor.c) */
+#define YCBCR_SCALEBITS 16
+#define YCBCR_FIX(x)    ((int32_t)((x) * (1L << YCBCR_SCALEBITS) + 0.5))
+#define YCBCR_Y_R       YCBCR_FIX(0.29900)
+#define YCBCR_Y_G       YCBCR_FIX(0.58700)
+#define YCBCR_Y_B       YCBCR_FIX(0.11400)
+#define YCBCR_CB_R      (-YCBCR_FIX(0.16874))
+#define YCBCR_CB_G      (-YCBCR_FIX(0.33126))
+#define YCBCR_CB_B      YCBCR_FIX(0.50000)
+#define YCBCR_CR_R      YCBCR_FIX(0.50000)
+#define YCBCR_CR_G      (-YCBCR_FIX(0.41869))
+#define YCBCR_CR_B      (-YCBCR_FIX(0.08131))
+
+/* chroma is calculated from the sum of 2x2 pixels, so it is scaled by 4 (2 more bits) */
+#define YCBCR_Y_ROUND     (1L << (YCBCR_SCALEBITS - 1))
+#define YCBCR_C_SHIFT     (YCBCR_SCALEBITS + 2)
+#define YCBCR_C_OFFSET    ((128L << YCBCR_C_SHIFT) + (1L << (YCBCR_C_SHIFT - 1)) - 1)
+
+/* expand RGB565 into 8 bits for each color */
+#define YCBCR_R565(p)     ((((p) >> 8) & 0xF8) | ((p) >> 13))
+#define YCBCR_G565(p)     ((((p) >> 3) & 0xFC) | (((p) >> 9) & 0x03))
+#define YCBCR_B565(p)     ((((p) << 3) & 0xF8) | (((p) >> 2) & 0x07))
+
+/* same as above for 2 pixels in a word (each 16-bit lane holds one pixel) */
+#define YCBCR_R565X2(w)   ((((w) >> 8) & 0x00F800F8) | (((w) >> 13) & 0x00070007))
+#define YCBCR_G565X2(w)   ((((w) >> 3) & 0x00FC00FC) | (((w) >> 9) & 0x00030003))
+#define YCBCR_B565X2(w)   ((((w) << 3) & 0x00F800F8) | (((w) >> 2) & 0x00070007))
+
+/* 2 signed 16-bit coefficients for SMLAD. FIX(0.587) and FIX(0.5) exceed int16, so G of Y is multiplied in two halves, and 0.5 is done by shift */
+#define YCBCR_PACK(lo, hi) ((((uint32_t)(lo)) & 0xFFFF) | (((uint32_t)(hi)) << 16))
+
+/*** Internal Static Variables ***/
+
+/*** Internal Function Declarations ***/
+
+/*** External Function Defines ***/
+/*
+ * convert 2 lines of RGB888 into 2 lines of Y and 1 line of Cb, Cr (4:2:0)
+ * p_rgb888 contains 2 lines (width * 3 * 2 bytes), width must be even
+ * chroma is calculated from the average of 2x2 pixels (instead of averaging Cb, Cr of each pixel like jcsample.c)
+ */
+void ycbcr_convertRGB888To420(const uint8_t *p_rgb888, uint32_t width, uint8_t *p_y0, uint8_t *p_y1, uint8_t *p_cb, uint8_t *p_cr)
+{
+  const uint8_t *p_line0 = p_rgb888;
+  const uint8_t *p_line1 = p_rgb888 + width * 3;
+
+  for(uint32_t x = 0; x < width / 2; x++) {
+    int32_t r00 = p_line0[0], g00 = p_line0[1], b00 = p_line0[2];
+    int32_t r01 = p_line0[3], g01 = p_line0[4], b01 = p_line0[5];
+    int32_t r10 = p_line1[0], g10 = p_line1[1], b10 = p_line1[2];
+    int32_t r11 = p_line1[3], g11 = p_line1[4], b11 = p_line1[5];
+    p_line0 += 6;
+    p_line1 += 6;
+
+    *p_y0++ = (uint8_t)((YCBCR_Y_R * r00 + YCBCR_Y_G * g00 + YCBCR_Y_B * b00 + YCBCR_Y_ROUND) >> YCBCR_SCALEBITS);
+    *p_y0++ = (uint8_t)((YCBCR_Y_R * r01 + YCBCR_Y_G * g01 + YCBCR_Y_B * b01 + YCBCR_Y_ROUND) >> YCBCR_SCALEBITS);
+    *p_y1++ = (uint8_t)((YCBCR_Y_R * r10 + YCBCR_Y_G * g10 + YCBCR_Y_B * b10 + YCBCR_Y_ROUND) >> YCBCR_SCALEBITS);
+    *p_y1++ = (uint8_t)((YCBCR_Y_R * r11 + YCBCR_Y_G * g11 + YCBCR_Y_B * b11 + YCBCR_Y_ROUND) >> YCBCR_SCALEBITS);
+
+    int32_t r = r00 + r01 + r10 + r11;
+    int32_t g = g00 + g01 + g10 + g11;
+    int32_t b = b00 + b01 + b10 + b11;
+    *p_cb++ = (uint8_t)((YCBCR_CB_R * r + YCBCR_CB_G * g + YCBCR_CB_B * b + YCBCR_C_OFFSET) >> YCBCR_C_SHIFT);
+    *p_cr++ = (uint8_t)((YCBCR_CR_R * r + YCBCR_CR_G * g + YCBCR_CR_B * b + YCBCR_C_OFFSET) >> YCBCR_C_SHIFT);
+  }
+}
+
+/*
+ * convert 2 lines of RGB565 (16-bit pixels captured into memory) into 2 lines of Y and 1 line of Cb, Cr (4:2:0)
+ * p_rgb565 contains 2 lines (width * 2 pixels). 5/6-bit values are expanded to 8 bits by repeating the upper bits
+ * uses SIMD instructions of Cortex-M4 (2 pixels at once) if available. p_rgb565 must be 4-byte aligned in this case
+ */
+void ycbcr_convertRGB565To420(const uint16_t *p_rgb565, uint32_t width, uint8_t *p_y0, uint8_t *p_y1, uint8_t *p_cb, uint8_t *p_cr)
+{
+#if YCBCR_USE_SIMD
+  /* 2 pixels are processed in a word. the result is exactly the same as the C code below */
+  const uint32_t *p_line0 = (const uint32_t *)p_rgb565;
+  const uint32_t *p_line1 = (const uint32_t *)(p_rgb565 + width);
+  const uint32_t kYRG = YCBCR_PACK(YCBCR_Y_R, YCBCR_Y_G / 2);
+  const uint32_t kYGB = YCBCR_PACK(YCBCR_Y_G / 2, YCBCR_Y_B);
+  const uint32_t kCbR = YCBCR_PACK(YCBCR_CB_R, YCBCR_CB_R);
+  const uint32_t kCbG = YCBCR_PACK(YCBCR_CB_G, YCBCR_CB_G);
+  const uint32_t kCrG = YCBCR_PACK(YCBCR_CR_G, YCBCR_CR_G);
+  const uint32_t kCrB = YCBCR_PACK(YCBCR_CR_B, YCBCR_CR_B);
+
+  for(uint32_t x = 0; x < width / 2; x++) {
+    uint32_t w0 = *p_line0++;
+    uint32_t w1 = *p_line1++;
+    uint32_t r0 = YCBCR_R565X2(w0), g0 = YCBCR_G565X2(w0), b0 = YCBCR_B565X2(w0);
+    uint32_t r1 = YCBCR_R565X2(w1), g1 = YCBCR_G565X2(w1), b1 = YCBCR_B565X2(w1);
+
+    /* Y = (R, G/2) . kYRG + (G/2, B) . kYGB */
+    *p_y0++ = (uint8_t)(__SMLAD(__PKHBT(r0, g0, 16), kYRG, __SMLAD(__PKHBT(g0, b0, 16), kYGB, YCBCR_Y_ROUND)) >> YCBCR_SCALEBITS);
+    *p_y0++ = (uint8_t)(__SMLAD(__PKHTB(g0, r0, 16), kYRG, __SMLAD(__PKHTB(b0, g0, 16), kYGB, YCBCR_Y_ROUND)) >> YCBCR_SCALEBITS);
+    *p_y1++ = (uint8_t)(__SMLAD(__PKHBT(r1, g1, 16), kYRG, __SMLAD(__PKHBT(g1, b1, 16), kYGB, YCBCR_Y_ROUND)) >> YCBCR_SCALEBITS);
+    *p_y1++ = (uint8_t)(__SMLAD(__PKHTB(g1, r1, 16), kYRG, __SMLAD(__PKHTB(b1, g1, 16), kYGB, YCBCR_Y_ROUND)) >> YCBCR_SCALEBITS);
+
+    /* vertical sum in each lane (no carry between lanes), then SMLAD adds the 2 lanes (horizontal sum) */
+    uint32_t r = r0 + r1;
+    uint32_t g = g0 + g1;
+    uint32_t b = b0 + b1;
+    int32_t cb = (int32_t)__SMLAD(r, kCbR, __SMLAD(g, kCbG, (((b & 0xFFFF) + (b >> 16)) << 15) + YCBCR_C_OFFSET));
+    int32_t cr = (int32_t)__SMLAD(g, kCrG, __SMLAD(b, kCrB, (((r & 0xFFFF) + (r >> 16)) << 15) + YCBCR_C_OFFSET));
+    *p_cb++ = (uint8_t)(cb >> YCBCR_C_SHIFT);
+    *p_cr++ = (uint8_t)(cr >> YCBCR_C_SHIFT);
+  }
+#else
+  const uint16_t *p_line0 = p_rgb565;
+  const uint16_t *p_line1 = p_rgb565 + width;
+
+  for(uint32_t x = 0; x < width / 2; x++) {
+    uint32_t p00 = p_line0[0], p01 = p_line0[1];
+    uint32_t p10 = p_line1[0], p11 = p_line1[1];
+    p_line0 += 2;
+    p_line1 += 2;
+    int32_t r00 = YCBCR_R565(p00), g00 = YCBCR_G565(p00), b00 = YCBCR_B565(p00);
+    int32_t r01 = YCBCR_R565(p01), g01 = YCBCR_G565(p01), b01 = YCBCR_B565(p01);
+    int32_t r10 = YCBCR_R565(p10), g10 = YCBCR_G565(p10), b10 = YCBCR_B565(p10);
+    int32_t r11 = YCBCR_R565(p11), g11 = YCBCR_G565(p11), b11 = YCBCR_B565(p11);
+
+    *p_y0++ = (uint8_t)((YCBCR_Y_R * r00 + YCBCR_Y_G * g00 + YCBCR_Y_B * b00 + YCBCR_Y_ROUND) >> YCBCR_SCALEBITS);
+    *p_y0++ = (uint8_t)((YCBCR_Y_R * r01 + YCBCR_Y_G * g01 + YCBCR_Y_B * b01 + YCBCR_Y_ROUND) >> YCBCR_SCALEBITS);
+    *p_y1++ = (uint8_t)((YCBCR_Y_R * r10 + YCBCR_Y_G * g10 + YCBCR_Y_B * b10 + YCBCR_Y_ROUND) >> YCBCR_SCALEBITS);
+    *p_y1++ = (uint8_t)((YCBCR_Y_R * r11 + YCBCR_Y_G * g11 + YCBCR_Y_B * b11 + YCBCR_Y_ROUND) >> YCBCR_SCALEBITS);
+
+    int32_t r = r00 + r01 + r10 + r11;
+    int32_t g = g00 + g01 + g10 + g11;
+    int32_t b = b00 + b01 + b10 + b11;
+    *p_cb++ = (uint8_t)((YCBCR_CB_R * r + YCBCR_CB_G * g + YCBCR_CB_B * b + YCBCR_C_OFFSET) >> YCBCR_C_SHIFT);
+    *p_cr++ = (uint8_t)((YCBCR_CR_R * r + YCBCR_CR_G * g + YCBCR_CR_B * b + YCBCR_C_OFFSET) >> YCBCR_C_SHIFT);
+  }
+#endif
+}
+
+/*
+ * split 1 line of YUV422 (U Y V Y) which was stored in display as RGB565 into Y, Cb, Cr
+ * display returns 6 bits for each color (RGB888 format, lower bits are padding),
+ * and the upper 5-6-5 bits of them are exactly the same as the 16-bit data written by camera (Y: upper byte, U/V: lower byte)
+ */
+void ycbcr_unpackYUV422(const uint8_t *p_rgb888, uint32_t width, uint8_t *p_y, uint8_t *p_cb, uint8_t *p_cr)
+{
+  for(uint32_t x = 0; x < width / 2; x++) {
+    *p_y++  = (p_rgb888[0] & 0xF8) | (p_rgb888[1] >> 5);
+    *p_cb++ = ((p_rgb888[1] & 0x1C) << 3) | (p_rgb888[2] >> 3);
+    *p_y++  = (p_rgb888[3] & 0xF8) | (p_rgb888[4] >> 5);
+    *p_cr++ = ((p_rgb888[4] & 0x1C) << 3) | (p_rgb888[5] >> 3);
+    p_rgb888 += 6;
+  }
+}
+
+/* same as ycbcr_unpackYUV422, but for 2 lines. Cb, Cr of the 2 lines are averaged (4:2:0) */
+void ycbcr_unpackYUV422To420(const uint8_t *p_rgb888, uint32_t width, uint8_t *p_y0, uint8_t *p_y1, uint8_t *p_cb, uint8_t *p_cr)
+{
+  const uint8_t *p_line0 = p_rgb888;
+  const uint8_t *p_line1 = p_rgb888 + width * 3;
+
+  for(uint32_t x = 0; x < width / 2; x++) {
+    *p_y0++ = (p_line0[0] & 0xF8) | (p_line0[1] >> 5);
+    *p_y0++ = (p_line0[3] & 0xF8) | (p_line0[4] >> 5);
+    *p_y1++ = (p_line1[0] & 0xF8) | (p_line1[1] >> 5);
+    *p_y1++ = (p_line1[3] & 0xF8) | (p_line1[4] >> 5);
+    uint32_t cb0 = ((p_line0[1] & 0x1C) << 3) | (p_line0[2] >> 3);
+    uint32_t cr0 = ((p_line0[4] & 0x1C) << 3) | (p_line0[5] >> 3);
+    uint32_t cb1 = ((p_line1[1] & 0x1C) << 3) | (p_line1[2] >> 3);
+    uint32_t cr1 = ((p_line1[4] & 0x1C) << 3) | (p_line1[5] >> 3);
+    *p_cb++ = (cb0 + cb1 + 1) >> 1;
+    *p_cr++ = (cr0 + cr1 + 1) >> 1;
+    p_line0 += 6;
+    p_line1 += 6;
+  }
+}
+
+/*
+ * split 1 line of YUV422 captured into memory into Y, Cb, Cr
+ * each 16-bit pixel is the same as the value written to display (Y: upper byte, U/V: lower byte)
+ */
+void ycbcr_unpackYUV422Pixel(const uint16_t *p_yuv422, uint32_t width, uint8_t *p_y, uint8_t *p_cb, uint8_t *p_cr)
+{
+  for(uint32_t x = 0; x < width / 2; x++) {
+    uint32_t p0 = p_yuv422[0], p1 = p_yuv422[1];
+    *p_y++  = p0 >> 8;
+    *p_cb++ = p0 & 0xFF;
+    *p_y++  = p1 >> 8;
+    *p_cr++ = p1 & 0xFF;
+    p_yuv422 += 2;
+  }
+}
+
+/* same as ycbcr_unpackYUV422Pixel, but for 2 lines. Cb, Cr of the 2 lines are averaged (4:2:0) */
+void ycbcr_unpackYUV422PixelTo420(const uint16_t *p_yuv422, uint32_t width, uint8_t *p_y0, uint8_t *p_y1, uint8_t *p_cb, uint8_t *p_cr)
+{
+  const uint16_t *p_line0 = p_yuv422;
+  const uint16_t *p_line1 = p_yuv422 + width;
+
+  for(uint32_t x = 0; x < width / 2; x++) {
+    uint32_t p00 = p_line0[0], p01 = p_line0[1];
+    uint32_t p10 = p_line1[0], p11 = p_line1[1];
+    *p_y0++ = p00 >> 8;
+    *p_y0++ = p01 >> 8;
+    *p_y1++ = p10 >> 8;
+    *p_y1++ = p11 >> 8;
+    *p_cb++ = ((p00 & 0xFF) + (p10 & 0xFF) + 1) >> 1;
+    *p_cr++ = ((p01 & 0xFF) + (p11 & 0xFF) + 1) >> 1;
+    p_line0 += 2;
+    p_line1 += 2;
+  }
+}
+
+/* convert YUV422 pixels into grayscale RGB565 (p_rgb565 can be the same as p_yuv422) */
+void ycbcr_convertYUV422ToRGB565Gray(const uint16_t *p_yuv422, uint32_t pixelNum, uint16_t *p_rgb565)
+{
+  for(uint32_t x = 0; x < pixelNum; x++) {
+    uint16_t y = *p_yuv422++ >> 8;
+    *p_rgb565++ = ((y & 0xF8) << 8) | ((y & 0xFC) << 3) | (y >> 3);
+  }
+}
+
+/* convert Y into grayscale RGB565 */
+void ycbcr_convertYToRGB565(const uint8_t *p_y, uint32_t width, uint16_t *p_rgb565)
+{
+  for(uint32_t x = 0; x < width; x++) {
+    uint16_t y = *p_y++;
+    *p_rgb565++ = ((y & 0xF8) << 8) | ((y & 0xFC) << 3) | (y >> 3);
+  }
+}
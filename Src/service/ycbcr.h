@@ -0,0 +1,20 @@
+/*
+ * ycbcr.h
+ *
+ *  Created on: 2017/09/14
+ *      Author: take-iwiw
+ */
+
+#ifndef SERVICE_YCBCR_H_
+#define SERVICE_YCBCR_H_
+
+void ycbcr_convertRGB888To420(const uint8_t *p_rgb888, uint32_t width, uint8_t *p_y0, uint8_t *p_y1, uint8_t *p_cb, uint8_t *p_cr);
+void ycbcr_convertRGB565To420(const uint16_t *p_rgb565, uint32_t width, uint8_t *p_y0, uint8_t *p_y1, uint8_t *p_cb, uint8_t *p_cr);
+void ycbcr_unpackYUV422(const uint8_t *p_rgb888, uint32_t width, uint8_t *p_y, uint8_t *p_cb, uint8_t *p_cr);
+void ycbcr_unpackYUV422To420(const uint8_t *p_rgb888, uint32_t width, uint8_t *p_y0, uint8_t *p_y1, uint8_t *p_cb, uint8_t *p_cr);
+void ycbcr_unpackYUV422Pixel(const uint16_t *p_yuv422, uint32_t width, uint8_t *p_y, uint8_t *p_cb, uint8_t *p_cr);
+void ycbcr_unpackYUV422PixelTo420(const uint16_t *p_yuv422, uint32_t width, uint8_t *p_y0, uint8_t *p_y1, uint8_t *p_cb, uint8_t *p_cr);
+void ycbcr_convertYUV422ToRGB565Gray(const uint16_t *p_yuv422, uint32_t pixelNum, uint16_t *p_rgb565);
+void ycbcr_convertYToRGB565(const uint8_t *p_y, uint32_t width, uint16_t *p_rgb565);
+
+#endif /* SERVICE_YCBCR_H_ */
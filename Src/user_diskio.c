@@ -68,7 +68,10 @@
 /* code for porting (refer to sample code by Chan-san) */
 #include "main.h"
 #include "stm32f4xx_hal.h"
+#include "cmsis_os.h"
 #include "common.h"
+#include "applicationSettings.h"
+#include "perf.h"
 
 /* Private typedef -----------------------------------------------------------*/
 /* Private define ------------------------------------------------------------*/
@@ -114,6 +117,10 @@ static volatile DSTATUS Stat = STA_NOINIT;
 /* code for porting (refer to sample code(mmc_stm32f1.c) by Chan-san) */
 extern SPI_HandleTypeDef hspi1;
 static BYTE CardType;      /* Card type flags */
+#if SD_SPI_DMA
+static volatile osThreadId s_dmaWaitingTask;  /* notified by the DMA complete callback */
+static volatile uint8_t s_isDmaError;
+#endif
 
 /*-----------------------------------------------------------------------*/
 /* SPI controls (Platform dependent)                                     */
@@ -149,26 +156,112 @@ BYTE xchg_spi (
 }
 
 
+#if SD_SPI_DMA
+/* Transfer multiple byte by DMA. the task sleeps until the DMA complete callback notifies it */
+static
+int dma_spi_multi (  /* 1:OK, 0:Error, -1:DMA is not available (use polling) */
+  BYTE *buff,   /* Pointer to data buffer */
+  UINT btx,     /* Number of bytes to transfer */
+  int isTx      /* 1:Send, 0:Receive */
+)
+{
+  HAL_StatusTypeDef ret;
+
+  if (btx < SD_SPI_DMA_MIN_SIZE) return -1;
+  if (((uint32_t)buff >= CCMDATARAM_BASE) && ((uint32_t)buff <= CCMDATARAM_END)) return -1;  /* DMA cannot access CCM RAM */
+  if (!osKernelRunning()) return -1;  /* the task cannot wait before the kernel starts */
+  if ((hspi1.State != HAL_SPI_STATE_READY) || (hspi1.hdmarx->State != HAL_DMA_STATE_READY) || (hspi1.hdmatx->State != HAL_DMA_STATE_READY)) return -1;
+
+  PERF_START(perfStart);
+  ulTaskNotifyTake(pdTRUE, 0);  /* clear a notification left by a transfer which timed out */
+  s_dmaWaitingTask = osThreadGetId();
+  s_isDmaError = 0;
+  if (isTx) {
+    ret = HAL_SPI_Transmit_DMA(&hspi1, buff, btx);
+  } else {
+    ret = HAL_SPI_Receive_DMA(&hspi1, buff, btx); /* MOSI sends the buffer as it is (same as HAL_SPI_Receive) */
+  }
+  PERF_STOP(PERF_SD_DMA, perfStart);
+  if (ret != HAL_OK) {
+    s_dmaWaitingTask = 0;
+    return -1;
+  }
+
+  if (ulTaskNotifyTake(pdTRUE, SD_SPI_DMA_TIMEOUT) == 0) {
+    s_dmaWaitingTask = 0;
+    HAL_SPI_Abort(&hspi1);
+    return 0;
+  }
+  return s_isDmaError ? 0 : 1;
+}
+
+static
+void dma_spi_done (
+  SPI_HandleTypeDef *hspi
+)
+{
+  BaseType_t isWoken = pdFALSE;
+  if ((hspi == &hspi1) && s_dmaWaitingTask) {
+    vTaskNotifyGiveFromISR((TaskHandle_t)s_dmaWaitingTask, &isWoken);
+    s_dmaWaitingTask = 0;
+  }
+  portYIELD_FROM_ISR(isWoken);
+}
+
+void HAL_SPI_TxCpltCallback(SPI_HandleTypeDef *hspi)
+{
+  dma_spi_done(hspi);
+}
+
+void HAL_SPI_RxCpltCallback(SPI_HandleTypeDef *hspi)
+{
+  dma_spi_done(hspi);
+}
+
+void HAL_SPI_ErrorCallback(SPI_HandleTypeDef *hspi)
+{
+  if (hspi == &hspi1) s_isDmaError = 1;
+  dma_spi_done(hspi);
+}
+#endif
+
+
 /* Receive multiple byte */
 static
-void rcvr_spi_multi (
+int rcvr_spi_multi (  /* 1:OK, 0:Error */
   BYTE *buff,   /* Pointer to data buffer */
   UINT btr    /* Number of bytes to receive (even number) */
 )
 {
-  HAL_SPI_Receive(&hspi1, buff, btr, 100);
+  HAL_StatusTypeDef ret;
+#if SD_SPI_DMA
+  int dmaRet = dma_spi_multi(buff, btr, 0);
+  if (dmaRet >= 0) return dmaRet;
+#endif
+  PERF_START(perfStart);
+  ret = HAL_SPI_Receive(&hspi1, buff, btr, 100);
+  PERF_STOP(PERF_SD_POLL, perfStart);
+  return (ret == HAL_OK) ? 1 : 0;
 }
 
 
 #if _USE_WRITE
 /* Send multiple byte */
 static
-void xmit_spi_multi (
+int xmit_spi_multi (  /* 1:OK, 0:Error */
   const BYTE *buff, /* Pointer to the data */
   UINT btx      /* Number of bytes to send (even number) */
 )
 {
-  HAL_SPI_Transmit(&hspi1, buff, btx, 100);
+  HAL_StatusTypeDef ret;
+#if SD_SPI_DMA
+  int dmaRet = dma_spi_multi((BYTE*)buff, btx, 1);
+  if (dmaRet >= 0) return dmaRet;
+#endif
+  PERF_START(perfStart);
+  ret = HAL_SPI_Transmit(&hspi1, (uint8_t*)buff, btx, 100);
+  PERF_STOP(PERF_SD_POLL, perfStart);
+  return (ret == HAL_OK) ? 1 : 0;
 }
 #endif
 
@@ -187,6 +280,8 @@ int wait_ready (  /* 1:Ready, 0:Timeout */
   do {
     d = xchg_spi(0xFF);
     /* This loop takes a time. Insert rot_rdq() here for multitask envilonment. */
+    /* the card is busy (e.g. programming flash). let other tasks (e.g. encoder during movie recording) run */
+    if( (d != 0xFF) && (HAL_GetTick() != start) && osKernelRunning() ) osDelay(1);
   } while (d != 0xFF && ((HAL_GetTick() - start) < wt));  /* Wait for card goes ready or timeout */
 
   return (d == 0xFF) ? 1 : 0;
@@ -234,7 +329,7 @@ int rcvr_datablock (  /* 1:OK, 0:Error */
   } while ((token == 0xFF) && ((HAL_GetTick() - start) < 200));
   if(token != 0xFE) return 0;   /* Function fails if invalid DataStart token or timeout */
 
-  rcvr_spi_multi(buff, btr);    /* Store trailing data to the buffer */
+  if (!rcvr_spi_multi(buff, btr)) return 0;  /* Store trailing data to the buffer */
   xchg_spi(0xFF); xchg_spi(0xFF);     /* Discard CRC */
 
   return 1;           /* Function succeeded */
@@ -257,7 +352,7 @@ int xmit_datablock (  /* 1:OK, 0:Failed */
 
   xchg_spi(token);          /* Send token */
   if (token != 0xFD) {        /* Send data if token is other than StopTran */
-    xmit_spi_multi(buff, 512);    /* Data */
+    if (!xmit_spi_multi(buff, 512)) return 0; /* Data */
     xchg_spi(0xFF); xchg_spi(0xFF); /* Dummy CRC */
 
     resp = xchg_spi(0xFF);        /* Receive data resp */
@@ -311,6 +406,181 @@ BYTE send_cmd (   /* Return value: R1 resp (bit7==1:Failed to send) */
   return res;             /* Return received response */
 }
 
+#if _USE_WRITE
+/*-----------------------------------------------------------------------*/
+/* Write a run of sectors (cached sectors, then sectors in buff)         */
+/*-----------------------------------------------------------------------*/
+static
+int write_run (   /* 1:OK, 0:Error */
+  DWORD sector,         /* Sector address in LBA */
+  const BYTE **pp_head, /* Cached sectors written first (sector, sector + 1, ...) */
+  UINT headNum,         /* Number of cached sectors */
+  const BYTE *buff,     /* Following sectors */
+  UINT count            /* Number of following sectors */
+)
+{
+  UINT n, total = headNum + count;
+  int ok = 0;
+
+  if (!(CardType & CT_BLOCK)) sector *= 512;  /* LBA ==> BA conversion (byte addressing cards) */
+
+  if (total == 1) { /* Single sector write */
+    if ((send_cmd(CMD24, sector) == 0)  /* WRITE_BLOCK */
+      && xmit_datablock(headNum ? pp_head[0] : buff, 0xFE)) {
+      ok = 1;
+    }
+  }
+  else {        /* Multiple sector write */
+    if (CardType & CT_SDC) send_cmd(ACMD23, total); /* Predefine number of sectors */
+    if (send_cmd(CMD25, sector) == 0) { /* WRITE_MULTIPLE_BLOCK */
+      for (n = 0; n < total; n++) {
+        if (!xmit_datablock((n < headNum) ? pp_head[n] : buff + 512 * (n - headNum), 0xFC)) break;
+      }
+      ok = (n == total);
+      if (!xmit_datablock(0, 0xFD)) ok = 0;  /* STOP_TRAN token */
+    }
+  }
+  fs_deselect();
+
+  return ok;
+}
+#endif
+
+#if _USE_WRITE && (SD_WRITE_CACHE_SECTORS > 0)
+/*-----------------------------------------------------------------------*/
+/* Write-back cache of sectors                                           */
+/*-----------------------------------------------------------------------*/
+/* sectors are not in order. all of them are dirty (written at cache_flush) */
+static BYTE  s_cacheBuff[SD_WRITE_CACHE_SECTORS][512];
+static DWORD s_cacheSector[SD_WRITE_CACHE_SECTORS];
+static UINT  s_cacheNum;
+
+static
+int cache_find (  /* index of the sector, or -1 */
+  DWORD sector
+)
+{
+  UINT i;
+  for (i = 0; i < s_cacheNum; i++) {
+    if (s_cacheSector[i] == sector) return i;
+  }
+  return -1;
+}
+
+static
+void cache_remove (
+  UINT index
+)
+{
+  s_cacheNum--;
+  if (index != s_cacheNum) {
+    s_cacheSector[index] = s_cacheSector[s_cacheNum];
+    memcpy(s_cacheBuff[index], s_cacheBuff[s_cacheNum], 512);
+  }
+}
+
+/* write all cached sectors. adjacent sectors are written at once */
+static
+int cache_flush (void)  /* 1:OK, 0:Error (the cache is cleared anyway) */
+{
+  const BYTE *p_run[SD_WRITE_CACHE_SECTORS];
+  BYTE order[SD_WRITE_CACHE_SECTORS];
+  UINT i, j, runNum;
+  int ok = 1;
+
+  /* sort by sector (insertion sort of indices) */
+  for (i = 0; i < s_cacheNum; i++) {
+    for (j = i; (j > 0) && (s_cacheSector[order[j - 1]] > s_cacheSector[i]); j--) order[j] = order[j - 1];
+    order[j] = i;
+  }
+
+  for (i = 0; i < s_cacheNum; i += runNum) {
+    for (runNum = 0; (i + runNum < s_cacheNum) && (s_cacheSector[order[i + runNum]] == s_cacheSector[order[i]] + runNum); runNum++) {
+      p_run[runNum] = s_cacheBuff[order[i + runNum]];
+    }
+    if (!write_run(s_cacheSector[order[i]], p_run, runNum, 0, 0)) ok = 0;
+  }
+  s_cacheNum = 0;
+
+  return ok;
+}
+
+/* keep one sector. the cache is flushed if full */
+static
+int cache_put (   /* 1:OK, 0:Error */
+  DWORD sector,
+  const BYTE *buff
+)
+{
+  int index = cache_find(sector);
+  int ok = 1;
+
+  if (index < 0) {
+    if (s_cacheNum == SD_WRITE_CACHE_SECTORS) ok = cache_flush();
+    index = s_cacheNum++;
+    s_cacheSector[index] = sector;
+  }
+  memcpy(s_cacheBuff[index], buff, 512);
+
+  return ok;
+}
+
+/* write sectors with the cached sectors just before them (they are removed from the cache) */
+static
+int cache_writeThrough (  /* 1:OK, 0:Error */
+  DWORD sector,
+  const BYTE *buff,
+  UINT count
+)
+{
+  const BYTE *p_head[SD_WRITE_CACHE_SECTORS];
+  DWORD headSector[SD_WRITE_CACHE_SECTORS];
+  UINT i, headNum = 0;
+  int index, ok;
+
+  /* cached sectors to be over-written are no longer needed */
+  for (i = 0; i < s_cacheNum; ) {
+    if ((s_cacheSector[i] >= sector) && (s_cacheSector[i] < sector + count)) {
+      cache_remove(i);
+    } else {
+      i++;
+    }
+  }
+
+  /* cached sectors just before them are sent by the same command */
+  while ((headNum < s_cacheNum) && (headNum < sector) && (cache_find(sector - headNum - 1) >= 0)) headNum++;
+  for (i = 0; i < headNum; i++) {
+    headSector[i] = sector - headNum + i;
+    p_head[i] = s_cacheBuff[cache_find(headSector[i])];
+  }
+
+  ok = write_run(sector - headNum, p_head, headNum, buff, count);
+
+  for (i = 0; i < headNum; i++) {
+    index = cache_find(headSector[i]);
+    cache_remove(index);
+  }
+
+  return ok;
+}
+
+/* over-write read data by the cached sectors (they are newer than the card) */
+static
+void cache_read (
+  DWORD sector,
+  BYTE *buff,
+  UINT count
+)
+{
+  UINT i;
+  for (i = 0; i < s_cacheNum; i++) {
+    if ((s_cacheSector[i] >= sector) && (s_cacheSector[i] < sector + count)) {
+      memcpy(buff + 512 * (s_cacheSector[i] - sector), s_cacheBuff[i], 512);
+    }
+  }
+}
+#endif
+
 /* USER CODE END DECL */
 
 /* Private function prototypes -----------------------------------------------*/
@@ -356,6 +626,9 @@ DSTATUS USER_initialize (
 
   if (pdrv) return STA_NOINIT;     /* Supports only drive 0 */
   init_spi();             /* Initialize SPI */
+#if _USE_WRITE && (SD_WRITE_CACHE_SECTORS > 0)
+  s_cacheNum = 0;         /* Sectors left in the cache are for the previous card */
+#endif
 
   if (Stat & STA_NODISK) return Stat; /* Is card existing in the soket? */
 
@@ -434,6 +707,12 @@ DRESULT USER_read (
   if (pdrv || !count) return RES_PARERR;   /* Check parameter */
   if (Stat & STA_NOINIT) return RES_NOTRDY; /* Check if drive is ready */
 
+#if _USE_WRITE && (SD_WRITE_CACHE_SECTORS > 0)
+  BYTE *buffTop = buff;
+  DWORD sectorTop = sector;
+  UINT countTop = count;
+#endif
+
   if (!(CardType & CT_BLOCK)) sector *= 512;  /* LBA ot BA conversion (byte addressing cards) */
 
   if (count == 1) { /* Single sector read */
@@ -453,6 +732,10 @@ DRESULT USER_read (
   }
   fs_deselect();
 
+#if _USE_WRITE && (SD_WRITE_CACHE_SECTORS > 0)
+  if (!count) cache_read(sectorTop, buffTop, countTop);
+#endif
+
   return count ? RES_ERROR : RES_OK;  /* Return result */
   /* USER CODE END READ */
 }
@@ -480,27 +763,19 @@ DRESULT USER_write (
   if (Stat & STA_NOINIT) return RES_NOTRDY; /* Check drive status */
   if (Stat & STA_PROTECT) return RES_WRPRT; /* Check write protect */
 
-  if (!(CardType & CT_BLOCK)) sector *= 512;  /* LBA ==> BA conversion (byte addressing cards) */
-
-  if (count == 1) { /* Single sector write */
-    if ((send_cmd(CMD24, sector) == 0)  /* WRITE_BLOCK */
-      && xmit_datablock(buff, 0xFE)) {
-      count = 0;
-    }
-  }
-  else {        /* Multiple sector write */
-    if (CardType & CT_SDC) send_cmd(ACMD23, count); /* Predefine number of sectors */
-    if (send_cmd(CMD25, sector) == 0) { /* WRITE_MULTIPLE_BLOCK */
-      do {
-        if (!xmit_datablock(buff, 0xFC)) break;
-        buff += 512;
-      } while (--count);
-      if (!xmit_datablock(0, 0xFD)) count = 1;  /* STOP_TRAN token */
+#if SD_WRITE_CACHE_SECTORS > 0
+  int ok = 1;
+  if (count <= SD_WRITE_CACHE_MAX_COUNT) {  /* Keep in the cache until sync */
+    for ( ; count; count--, sector++, buff += 512) {
+      if (!cache_put(sector, buff)) ok = 0;
     }
+  } else {
+    ok = cache_writeThrough(sector, buff, count);
   }
-  fs_deselect();
-
-  return count ? RES_ERROR : RES_OK;  /* Return result */
+  return ok ? RES_OK : RES_ERROR;  /* Return result */
+#else
+  return write_run(sector, 0, 0, buff, count) ? RES_OK : RES_ERROR;  /* Return result */
+#endif
   /* USER CODE END WRITE */
 }
 #endif /* _USE_WRITE == 1 */
@@ -530,6 +805,12 @@ DRESULT USER_ioctl (
 
   res = RES_ERROR;
 
+#if _USE_WRITE && (SD_WRITE_CACHE_SECTORS > 0)
+  if ((cmd == CTRL_SYNC) || (cmd == CTRL_TRIM)) { /* Write cached sectors first */
+    if (!cache_flush()) return RES_ERROR;
+  }
+#endif
+
   switch (cmd) {
   case CTRL_SYNC :    /* Wait for end of internal write process of the drive */
     if (fs_select()) res = RES_OK;